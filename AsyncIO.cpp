@@ -0,0 +1,363 @@
+#include "AsyncIO.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+#ifdef ENABLE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// Reads exactly length bytes unless the file ends or an error occurs
+bool preadFully(int fd, char* buffer, uint64_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t n = pread(fd, buffer, length, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buffer += n;
+        offset += static_cast<uint64_t>(n);
+        length -= static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+// Fallback engine: blocking preads spread over a few threads shared by the whole process
+class PreadPool {
+public:
+    using Task = std::function<void()>;
+
+    static PreadPool& instance() {
+        static PreadPool pool;
+        return pool;
+    }
+
+    void post(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        ready.notify_one();
+    }
+
+    ~PreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+private:
+    PreadPool() {
+        // Enough to keep an SSD's queue busy; reads are short and mostly wait on the device
+        unsigned count = std::max(4u, std::min(16u, std::thread::hardware_concurrency()));
+        for (unsigned i = 0; i < count; ++i) {
+            threads.emplace_back([this]() {
+                while (true) {
+                    Task task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                        if (tasks.empty()) return;
+                        task = std::move(tasks.front());
+                        tasks.pop_front();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Task> tasks;
+    bool stopping = false;
+};
+
+} // namespace
+
+
+// -------------------- ReadBatch --------------------
+ReadBatch::~ReadBatch() {
+    if (reader && !waited) wait();
+    for (const auto& file : files) close(file.second);
+}
+
+
+bool ReadBatch::add(const std::string& path, uint64_t offset, uint64_t length, char* buffer) {
+    auto file = files.find(path);
+    if (file == files.end()) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        file = files.emplace(path, fd).first;
+    }
+    requests.push_back({this, file->second, offset, length, buffer});
+    totalBytes += length;
+    return true;
+}
+
+
+void ReadBatch::submit() {
+    remaining = requests.size();
+    completions.reserve(requests.size());
+    reader = &AsyncReader::forThisThread();
+    reader->submit(*this);
+}
+
+
+bool ReadBatch::wait() {
+    if (!reader) return requests.empty();
+    if (!waited) {
+        reader->waitUntil(*this, [this]() { return remaining == 0; });
+        waited = true;
+    }
+    return !failed;
+}
+
+
+size_t ReadBatch::waitNext(bool& ok) {
+    if (!reader || returned == requests.size()) return npos;
+    reader->waitUntil(*this, [this]() { return returned < completions.size(); });
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ok = completions[returned].second;
+    return completions[returned++].first;
+}
+
+
+void ReadBatch::complete(const Request& request, bool ok) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ok) failed = true;
+    completions.push_back({static_cast<size_t>(&request - requests.data()), ok});
+    --remaining;
+    done.notify_all();
+}
+
+
+// -------------------- AsyncReader --------------------
+#ifdef ENABLE_IO_URING
+
+// Submission and completion queues shared with the kernel (see io_uring_setup(2))
+struct AsyncReader::Ring {
+    static const unsigned entries = 64;
+
+    int fd = -1;
+    void* sqMap = nullptr;
+    size_t sqMapSize = 0;
+    void* cqMap = nullptr;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    bool setup() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return false;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) {
+            sqMap = nullptr;
+            return false;
+        }
+        if (singleMap) {
+            cqMap = sqMap;
+        } else {
+            cqMap = mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqMap == MAP_FAILED) {
+                cqMap = nullptr;
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqesMap == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqesMap);
+
+        char* sq = static_cast<char*>(sqMap);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+
+        char* cq = static_cast<char*>(cqMap);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    ~Ring() {
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqMap && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap) munmap(sqMap, sqMapSize);
+        if (fd >= 0) close(fd);
+    }
+};
+
+AsyncReader::AsyncReader() {
+    // Seccomp filters and old kernels may forbid io_uring; the pread pool then takes over
+    auto candidate = std::make_unique<Ring>();
+    if (candidate->setup()) ring = std::move(candidate);
+}
+
+
+void AsyncReader::fillRing() {
+    unsigned tail = *ring->sqTail;
+    unsigned toSubmit = 0;
+    std::vector<ReadBatch::Request*> placed;
+    while (!queued.empty() && inFlight < ring->sqEntries) {
+        ReadBatch::Request* request = queued.front();
+        queued.pop_front();
+        placed.push_back(request);
+
+        unsigned slot = tail & *ring->sqMask;
+        io_uring_sqe* sqe = &ring->sqes[slot];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = request->fd;
+        sqe->off = request->offset;
+        sqe->addr = reinterpret_cast<uint64_t>(request->buffer);
+        sqe->len = static_cast<uint32_t>(request->length);
+        sqe->user_data = reinterpret_cast<uint64_t>(request);
+        ring->sqArray[slot] = slot;
+
+        tail++;
+        toSubmit++;
+        inFlight++;
+    }
+    if (toSubmit == 0) return;
+
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    while (toSubmit > 0) {
+        int submitted = ring->enter(toSubmit, 0, 0);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                reapCompletions(false);
+                continue;
+            }
+
+            // The kernel left the last toSubmit entries unconsumed: take them back and read them here
+            __atomic_store_n(ring->sqTail, tail - toSubmit, __ATOMIC_RELEASE);
+            for (size_t i = placed.size() - toSubmit; i < placed.size(); ++i) {
+                ReadBatch::Request* request = placed[i];
+                request->batch->complete(*request, preadFully(request->fd, request->buffer, request->length, request->offset));
+            }
+            inFlight -= toSubmit;
+            break;
+        }
+        toSubmit -= static_cast<unsigned>(submitted);
+    }
+}
+
+
+void AsyncReader::reapCompletions(bool block) {
+    if (block) ring->enter(0, 1, IORING_ENTER_GETEVENTS);
+
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        const io_uring_cqe& cqe = ring->cqes[head & *ring->cqMask];
+        auto* request = reinterpret_cast<ReadBatch::Request*>(cqe.user_data);
+        int64_t result = cqe.res;
+        head++;
+        inFlight--;
+
+        // Short reads and errors (e.g. a kernel without IORING_OP_READ) are finished synchronously
+        bool ok = (result >= 0 && static_cast<uint64_t>(result) == request->length);
+        if (!ok) {
+            uint64_t done = (result > 0) ? static_cast<uint64_t>(result) : 0;
+            ok = preadFully(request->fd, request->buffer + done, request->length - done, request->offset + done);
+        }
+        request->batch->complete(*request, ok);
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+#else
+
+struct AsyncReader::Ring {};
+
+AsyncReader::AsyncReader() {}
+
+void AsyncReader::fillRing() {}
+
+void AsyncReader::reapCompletions(bool) {}
+
+#endif // ENABLE_IO_URING
+
+
+AsyncReader::~AsyncReader() {
+    // Batches normally wait themselves; this only drains reads of batches that were abandoned
+    while (ring && inFlight > 0) reapCompletions(true);
+}
+
+
+AsyncReader& AsyncReader::forThisThread() {
+    static thread_local AsyncReader reader;
+    return reader;
+}
+
+
+void AsyncReader::submit(ReadBatch& batch) {
+    if (ring) {
+        for (auto& request : batch.requests) queued.push_back(&request);
+        fillRing();
+        return;
+    }
+
+    for (auto& request : batch.requests) {
+        ReadBatch::Request* pending = &request;
+        PreadPool::instance().post([pending]() {
+            pending->batch->complete(*pending, preadFully(pending->fd, pending->buffer, pending->length, pending->offset));
+        });
+    }
+}
+
+
+void AsyncReader::waitUntil(ReadBatch& batch, const std::function<bool()>& ready) {
+    if (ring) {
+        // Completions of other batches of this thread are recorded along the way
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                if (ready()) return;
+            }
+            reapCompletions(inFlight > 0);
+            fillRing();
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, ready);
+}
@@ -0,0 +1,103 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class AsyncReader;
+
+// A set of positioned reads that are issued together and complete in any order, so a query
+// pays roughly one I/O round-trip instead of one per term. Buffers belong to the caller and,
+// like the batch itself, must stay valid until wait() returns or waitNext() has returned every read.
+class ReadBatch {
+public:
+    ReadBatch() = default;
+    ~ReadBatch(); // Waits for reads still in flight, then closes the files
+    ReadBatch(const ReadBatch&) = delete;
+    ReadBatch& operator=(const ReadBatch&) = delete;
+
+    // Queues a read of length bytes at offset in path into buffer; false if path cannot be opened
+    bool add(const std::string& path, uint64_t offset, uint64_t length, char* buffer);
+
+    // Starts every queued read on the calling thread's AsyncReader without blocking
+    void submit();
+
+    // Blocks until all reads completed; false if any failed. Must run on the submitting thread.
+    bool wait();
+
+    // Blocks until a read not returned before has completed and returns its index (in add() order),
+    // so callers can use each buffer as it lands; npos once every read was returned. ok reports
+    // whether that read succeeded. Must run on the submitting thread.
+    static const size_t npos = static_cast<size_t>(-1);
+    size_t waitNext(bool& ok);
+
+    size_t size() const { return requests.size(); }
+    uint64_t bytes() const { return totalBytes; }
+
+private:
+    friend class AsyncReader;
+
+    struct Request {
+        ReadBatch* batch;
+        int fd;
+        uint64_t offset;
+        uint64_t length;
+        char* buffer;
+    };
+
+    // Records the outcome of one request; called from whichever thread completed it
+    void complete(const Request& request, bool ok);
+
+    std::unordered_map<std::string, int> files; // path -> descriptor, one open() per file
+    std::vector<Request> requests;
+    uint64_t totalBytes = 0;
+    AsyncReader* reader = nullptr; // Set by submit()
+    bool waited = false;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = 0;
+    bool failed = false;
+    std::vector<std::pair<size_t, bool>> completions; // (request, ok) in completion order
+    size_t returned = 0;                              // Completions already handed out by waitNext()
+};
+
+// Per-thread engine behind ReadBatch. Compiled with -DENABLE_IO_URING it owns an io_uring
+// instance; without the flag, or when the kernel refuses to create a ring, reads go to a
+// process-wide pool of pread threads instead.
+class AsyncReader {
+public:
+    static AsyncReader& forThisThread();
+    ~AsyncReader();
+
+    bool usingIoUring() const { return ring != nullptr; }
+
+    void submit(ReadBatch& batch);
+
+    // Blocks until ready() holds; ready is evaluated with the batch's mutex held
+    void waitUntil(ReadBatch& batch, const std::function<bool()>& ready);
+
+private:
+    AsyncReader();
+
+    struct Ring;
+
+    // io_uring: moves queued requests into free submission slots and submits them
+    void fillRing();
+
+    // io_uring: handles every available completion, blocking for at least one if asked
+    void reapCompletions(bool block);
+
+    std::unique_ptr<Ring> ring;
+    std::deque<ReadBatch::Request*> queued; // Waiting for a free submission slot
+    unsigned inFlight = 0;
+};
+
+#endif // ASYNC_IO_H
@@ -0,0 +1,93 @@
+#include "DeletedDocs.h"
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+bool DeletedDocs::load(const std::string& indexPath) {
+    bits.clear();
+    numDeleted = 0;
+
+    std::ifstream file(indexPath + "/deleted_docs.dat", std::ios::binary);
+    if (!file.is_open()) {
+        return true; // No deletions yet
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    // The word count must match the file size, so a corrupt header cannot request a huge bitmap
+    uint64_t numWords = 0;
+    if (!file.read(reinterpret_cast<char*>(&numWords), sizeof(numWords)) ||
+        numWords != (fileSize - sizeof(numWords)) / sizeof(uint64_t) ||
+        (fileSize - sizeof(numWords)) % sizeof(uint64_t) != 0) {
+        std::cerr << " ERROR: Corrupt deleted docs file in " << indexPath << std::endl;
+        return false;
+    }
+
+    bits.resize(numWords);
+    if (!file.read(reinterpret_cast<char*>(bits.data()), numWords * sizeof(uint64_t))) {
+        std::cerr << " ERROR: Truncated deleted docs file in " << indexPath << std::endl;
+        bits.clear();
+        return false;
+    }
+
+    for (uint64_t word : bits) {
+        numDeleted += __builtin_popcountll(word);
+    }
+    return true;
+}
+
+
+bool DeletedDocs::save(const std::string& indexPath) const {
+    // Write to a temporary file and rename, so readers never see a partial bitmap
+    std::string path = indexPath + "/deleted_docs.dat";
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << " ERROR: Could not write deleted docs file in " << indexPath << std::endl;
+            return false;
+        }
+
+        uint64_t numWords = bits.size();
+        file.write(reinterpret_cast<const char*>(&numWords), sizeof(numWords));
+        file.write(reinterpret_cast<const char*>(bits.data()), numWords * sizeof(uint64_t));
+        if (!file) {
+            return false;
+        }
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+
+bool DeletedDocs::markDeleted(int docID) {
+    if (docID < 0) return false;
+
+    size_t word = static_cast<size_t>(docID) >> 6;
+    if (word >= bits.size()) {
+        bits.resize(word + 1, 0);
+    }
+
+    uint64_t mask = uint64_t(1) << (docID & 63);
+    if (bits[word] & mask) return false;
+
+    bits[word] |= mask;
+    numDeleted++;
+    return true;
+}
+
+
+std::vector<int> DeletedDocs::deletedIDs() const {
+    std::vector<int> docIDs;
+    docIDs.reserve(numDeleted);
+    for (size_t word = 0; word < bits.size(); ++word) {
+        uint64_t remaining = bits[word];
+        while (remaining) {
+            int bit = __builtin_ctzll(remaining);
+            docIDs.push_back(static_cast<int>(word * 64 + bit));
+            remaining &= remaining - 1;
+        }
+    }
+    return docIDs;
+}
@@ -0,0 +1,39 @@
+#ifndef DELETED_DOCS_H
+#define DELETED_DOCS_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Compact tombstone bitmap of deleted docIDs, persisted as deleted_docs.dat
+class DeletedDocs {
+public:
+    // Loads the bitmap from the index directory (a missing file means nothing is deleted)
+    bool load(const std::string& indexPath);
+
+    // Writes the bitmap back to the index directory
+    bool save(const std::string& indexPath) const;
+
+    // Marks a docID as deleted; returns false if it already was
+    bool markDeleted(int docID);
+
+    // Checked for every posting, so kept inline and branch-light
+    bool isDeleted(int docID) const {
+        size_t word = static_cast<size_t>(docID) >> 6;
+        return word < bits.size() && ((bits[word] >> (docID & 63)) & 1);
+    }
+
+    // All deleted docIDs in increasing order
+    std::vector<int> deletedIDs() const;
+
+    // Number of docIDs marked as deleted
+    int count() const { return numDeleted; }
+
+    bool empty() const { return numDeleted == 0; }
+
+private:
+    std::vector<uint64_t> bits;
+    int numDeleted = 0;
+};
+
+#endif // DELETED_DOCS_H
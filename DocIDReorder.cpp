@@ -0,0 +1,227 @@
+#include "DocIDReorder.h"
+#include "InvertedIndex.h"
+#include "PositionalIndex.h"
+#include "DeletedDocs.h"
+#include "utils.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+
+// MinHash functions per document; more makes the clustering finer at linear extra cost
+const int signatureSize = 4;
+
+using Signature = std::array<uint64_t, signatureSize>;
+
+// splitmix64 finalizer: a cheap, well-mixed hash of the term number
+uint64_t mixHash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+double gapBits(const std::vector<Posting>& postings) {
+    double bits = 0.0;
+    int previous = -1;
+    for (const auto& posting : postings) {
+        bits += std::log2(static_cast<double>(posting.docID - previous));
+        previous = posting.docID;
+    }
+    return bits;
+}
+
+bool replaceFile(const std::string& tmpPath, const std::string& path) {
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::cerr << " ERROR: Could not replace " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool reorderDocIDs(const std::string& indexPath, ReorderStats& stats) {
+    auto start = std::chrono::high_resolution_clock::now();
+    stats = ReorderStats();
+
+    // Step 1: Load the main index and its doc tables
+    std::vector<std::wstring> terms;
+    std::vector<std::vector<Posting>> lists;
+    {
+        std::ifstream indexFile(indexPath + "/final_index.dat");
+        if (!indexFile.is_open()) {
+            std::cerr << " ERROR: No final_index.dat in " << indexPath << std::endl;
+            return false;
+        }
+        std::string line;
+        std::wstring term;
+        std::vector<Posting> postings;
+        while (std::getline(indexFile, line)) {
+            if (line.empty() || !InvertedIndex::parsePostingsLine(line, term, postings)) continue;
+            terms.push_back(term);
+            lists.push_back(postings);
+        }
+    }
+
+    std::map<int, int> docLengths;
+    std::map<int, int> docIDToDocno;
+    {
+        std::ifstream docLengthsFile(indexPath + "/final_doclengths.dat");
+        std::ifstream docIDToDocnoFile(indexPath + "/final_docid_to_docno.dat");
+        int docID, value;
+        while (docLengthsFile >> docID >> value) docLengths[docID] = value;
+        while (docIDToDocnoFile >> docID >> value) docIDToDocno[docID] = value;
+    }
+
+    // Every docID of the main index, whether or not it has a length entry
+    std::vector<int> docs;
+    for (const auto& entry : docIDToDocno) docs.push_back(entry.first);
+    for (const auto& entry : docLengths) {
+        if (!docIDToDocno.count(entry.first)) docs.push_back(entry.first);
+    }
+    std::sort(docs.begin(), docs.end());
+    if (docs.empty()) {
+        std::cerr << " ERROR: Empty document table in " << indexPath << std::endl;
+        return false;
+    }
+    stats.numDocs = static_cast<int>(docs.size());
+
+    std::unordered_map<int, size_t> slotOf;
+    for (size_t i = 0; i < docs.size(); ++i) slotOf[docs[i]] = i;
+
+    // Step 2: MinHash signature of each document's terms (terms in a single document add no gaps)
+    Signature empty;
+    empty.fill(std::numeric_limits<uint64_t>::max());
+    std::vector<Signature> signatures(docs.size(), empty);
+
+    for (size_t t = 0; t < lists.size(); ++t) {
+        if (lists[t].size() < 2) continue;
+
+        Signature hashes;
+        for (int k = 0; k < signatureSize; ++k) hashes[k] = mixHash(t * signatureSize + k);
+
+        for (const auto& posting : lists[t]) {
+            auto slot = slotOf.find(posting.docID);
+            if (slot == slotOf.end()) continue;
+            Signature& signature = signatures[slot->second];
+            for (int k = 0; k < signatureSize; ++k) signature[k] = std::min(signature[k], hashes[k]);
+        }
+    }
+
+    // Step 3: Documents with equal leading MinHashes share terms, so sorting clusters them.
+    // New IDs are the old IDs handed out in that order, keeping the docID range unchanged.
+    std::vector<size_t> order(docs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return signatures[a] < signatures[b]; });
+
+    std::unordered_map<int, int> newID;
+    for (size_t i = 0; i < order.size(); ++i) newID[docs[order[i]]] = docs[i];
+    auto remap = [&](int docID) {
+        auto it = newID.find(docID);
+        return it == newID.end() ? docID : it->second;
+    };
+
+    // Step 4: Rewrite postings (and positions) in the new docID order
+    PositionsFile positionsFile;
+    bool positional = positionsFile.load(indexPath);
+    std::ifstream positionsData;
+    if (positional) positionsData.open(positionsFile.path, std::ios::binary);
+
+    std::ofstream indexOut(indexPath + "/final_index.dat.tmp");
+    std::ofstream positionsOut;
+    std::ofstream positionsLexiconOut;
+    if (positional) {
+        positionsOut.open(indexPath + "/final_positions.dat.tmp", std::ios::binary);
+        positionsLexiconOut.open(indexPath + "/final_positions_lexicon.dat.tmp");
+    }
+
+    for (size_t t = 0; t < lists.size(); ++t) {
+        std::vector<Posting>& postings = lists[t];
+        stats.gapBitsBefore += gapBits(postings);
+
+        std::vector<std::vector<int>> positions;
+        if (positional) {
+            auto block = positionsFile.blocks.find(terms[t]);
+            std::string bytes;
+            if (block != positionsFile.blocks.end()) {
+                bytes.resize(block->second.second);
+                positionsData.seekg(block->second.first);
+                positionsData.read(&bytes[0], bytes.size());
+            }
+            PositionListReader reader(std::move(bytes));
+            for (size_t i = 0; i < postings.size(); ++i) positions.push_back(reader.positionsAt(i));
+        }
+
+        std::vector<size_t> permutation(postings.size());
+        std::iota(permutation.begin(), permutation.end(), 0);
+        for (auto& posting : postings) posting.docID = remap(posting.docID);
+        std::sort(permutation.begin(), permutation.end(),
+                  [&](size_t a, size_t b) { return postings[a].docID < postings[b].docID; });
+
+        std::vector<Posting> reordered;
+        reordered.reserve(postings.size());
+        for (size_t i : permutation) reordered.push_back(postings[i]);
+        stats.gapBitsAfter += gapBits(reordered);
+
+        std::string utf8Term = wstringToUtf8(terms[t]);
+        indexOut << utf8Term << " " << reordered.size() << " ";
+        for (const auto& p : reordered) indexOut << p.docID << " ";
+        for (const auto& p : reordered) indexOut << p.frequency << " ";
+        indexOut << "\n";
+
+        if (positional) {
+            std::string block;
+            for (size_t i : permutation) encodePositions(positions[i], block);
+            positionsLexiconOut << utf8Term << " " << positionsOut.tellp() << " " << block.size() << "\n";
+            positionsOut.write(block.data(), block.size());
+        }
+    }
+    indexOut.close();
+    positionsOut.close();
+    positionsLexiconOut.close();
+
+    // Step 5: Doc tables keep their values under the new IDs, so docnos are preserved
+    {
+        std::map<int, int> remappedLengths;
+        std::map<int, int> remappedDocnos;
+        for (const auto& [docID, length] : docLengths) remappedLengths[remap(docID)] = length;
+        for (const auto& [docID, docno] : docIDToDocno) remappedDocnos[remap(docID)] = docno;
+
+        std::ofstream docLengthsOut(indexPath + "/final_doclengths.dat.tmp");
+        for (const auto& [docID, length] : remappedLengths) docLengthsOut << docID << " " << length << "\n";
+        std::ofstream docIDToDocnoOut(indexPath + "/final_docid_to_docno.dat.tmp");
+        for (const auto& [docID, docno] : remappedDocnos) docIDToDocnoOut << docID << " " << docno << "\n";
+    }
+
+    bool ok = replaceFile(indexPath + "/final_index.dat.tmp", indexPath + "/final_index.dat") &&
+              replaceFile(indexPath + "/final_doclengths.dat.tmp", indexPath + "/final_doclengths.dat") &&
+              replaceFile(indexPath + "/final_docid_to_docno.dat.tmp", indexPath + "/final_docid_to_docno.dat");
+    if (ok && positional) {
+        ok = replaceFile(indexPath + "/final_positions.dat.tmp", indexPath + "/final_positions.dat") &&
+             replaceFile(indexPath + "/final_positions_lexicon.dat.tmp", indexPath + "/final_positions_lexicon.dat");
+    }
+
+    // Tombstones follow their documents; those of segment documents keep their IDs
+    DeletedDocs deleted;
+    if (ok && deleted.load(indexPath) && !deleted.empty()) {
+        DeletedDocs remapped;
+        for (int docID : deleted.deletedIDs()) remapped.markDeleted(remap(docID));
+        ok = remapped.save(indexPath);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << " Reordered " << stats.numDocs << " documents in " << elapsed.count() << " seconds. Gap cost: "
+              << stats.gapBitsBefore / 8e6 << " MB -> " << stats.gapBitsAfter / 8e6 << " MB" << std::endl;
+    return ok;
+}
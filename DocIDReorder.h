@@ -0,0 +1,19 @@
+#ifndef DOCID_REORDER_H
+#define DOCID_REORDER_H
+
+#include <string>
+
+// Outcome of a docID reassignment pass
+struct ReorderStats {
+    int numDocs = 0;
+    double gapBitsBefore = 0.0; // sum of log2(d-gap) over all postings: the compressed-size proxy
+    double gapBitsAfter = 0.0;
+};
+
+// Renumbers the documents of the main index in indexPath so that documents sharing terms get
+// nearby docIDs (documents sorted by a MinHash signature of their terms). Postings, positions,
+// doc lengths, the docno table and tombstones are rewritten consistently; docnos are preserved.
+// The new docIDs reuse the main index's docID range, so delta segments are unaffected.
+bool reorderDocIDs(const std::string& indexPath, ReorderStats& stats);
+
+#endif // DOCID_REORDER_H
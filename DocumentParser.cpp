@@ -1,5 +1,6 @@
 #include "DocumentParser.h"
 #include "utils.h"
+#include "Metrics.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -7,8 +8,8 @@
 #include <codecvt>
 #include <chrono>
 
-DocumentParser::DocumentParser(const std::string& datasetPath, int numDocs)
-    : datasetPath(datasetPath), numDocs(numDocs) {}
+DocumentParser::DocumentParser(const std::string& datasetPath, int numDocs, int firstDocID)
+    : datasetPath(datasetPath), numDocs(numDocs), firstDocID(firstDocID) {}
 
 void DocumentParser::parseDocuments() {
     std::ifstream file(datasetPath);
@@ -18,12 +19,13 @@ void DocumentParser::parseDocuments() {
     }
 
     auto start = std::chrono::high_resolution_clock::now(); // Start timing
+    METRIC_STAGE(Parse);
 
     std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
     std::string line;
-    int docID = 0;
+    int docID = firstDocID;
 
-    while (std::getline(file, line) && (numDocs == -1 || docID < numDocs)) {
+    while (std::getline(file, line) && (numDocs == -1 || docID - firstDocID < numDocs)) {
         try {
             std::wstring wline = converter.from_bytes(line);
 
@@ -73,7 +75,7 @@ void DocumentParser::parseDocuments() {
     auto end = std::chrono::high_resolution_clock::now(); // End timing
     std::chrono::duration<double> elapsed = end - start;
 
-    std::wcout << L"Total documents parsed and processed: " << docID << std::endl;
+    std::wcout << L"Total documents parsed and processed: " << docID - firstDocID << std::endl;
     std::cout << "Document parsing and preprocessing completed in " << elapsed.count() << " seconds." << std::endl;
 }
 
@@ -6,13 +6,14 @@
 
 class DocumentParser {
 public:
-    DocumentParser(const std::string& datasetPath, int numDocs);
+    DocumentParser(const std::string& datasetPath, int numDocs, int firstDocID = 0);
     void parseDocuments();
     const std::unordered_map<int, std::wstring>& getDocuments() const;
 
 private:
     std::string datasetPath;
     int numDocs;
+    int firstDocID; // DocIDs continue from here when appending a batch to an existing index
     std::unordered_map<int, std::wstring> documents;
 };
 
@@ -0,0 +1,84 @@
+#include "IndexManifest.h"
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+
+IndexManifest IndexManifest::forCurrentBuild(int numDocs) {
+    IndexManifest manifest;
+    manifest.numDocs = numDocs;
+#ifdef ENABLE_STEMMING
+    manifest.stemming = true;
+#endif
+#ifdef ENABLE_STOPWORDS
+    manifest.stopwords = true;
+#endif
+    return manifest;
+}
+
+
+bool IndexManifest::load(const std::string& indexPath) {
+    std::ifstream file(indexPath + "/manifest.dat");
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Unknown keys are ignored so newer manifests stay readable
+    formatVersion = 0;
+    std::string key;
+    int value;
+    while (file >> key >> value) {
+        if (key == "format_version") formatVersion = value;
+        else if (key == "num_docs") numDocs = value;
+        else if (key == "stemming") stemming = (value != 0);
+        else if (key == "stopwords") stopwords = (value != 0);
+        else if (key == "positions") positions = (value != 0);
+        else if (key == "shards") shards = value;
+        else if (key == "tier1_postings") tier1Postings = value;
+    }
+    return formatVersion != 0;
+}
+
+
+bool IndexManifest::save(const std::string& indexPath) const {
+    std::string path = indexPath + "/manifest.dat";
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << " ERROR: Could not write manifest in " << indexPath << std::endl;
+            return false;
+        }
+        file << "format_version " << formatVersion << "\n";
+        file << "num_docs " << numDocs << "\n";
+        file << "stemming " << (stemming ? 1 : 0) << "\n";
+        file << "stopwords " << (stopwords ? 1 : 0) << "\n";
+        file << "positions " << (positions ? 1 : 0) << "\n";
+        file << "shards " << shards << "\n";
+        file << "tier1_postings " << tier1Postings << "\n";
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+
+bool IndexManifest::isCompatible(std::string& error) const {
+    IndexManifest current = forCurrentBuild(numDocs);
+
+    if (formatVersion != current.formatVersion) {
+        error = "index format version " + std::to_string(formatVersion) +
+                " does not match supported version " + std::to_string(current.formatVersion);
+        return false;
+    }
+
+    // Query terms must be preprocessed exactly like the indexed documents
+    if (stemming != current.stemming) {
+        error = std::string("index was built ") + (stemming ? "with" : "without") +
+                " stemming, rebuild or recompile with matching -DENABLE_STEMMING";
+        return false;
+    }
+    if (stopwords != current.stopwords) {
+        error = std::string("index was built ") + (stopwords ? "with" : "without") +
+                " stopword removal, rebuild or recompile with matching -DENABLE_STOPWORDS";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef INDEX_MANIFEST_H
+#define INDEX_MANIFEST_H
+
+#include <string>
+
+// Describes how an index directory was built, so a server can reuse it without re-parsing the corpus
+struct IndexManifest {
+    // Bumped whenever the on-disk layout of the final_* files changes
+    static const int currentFormatVersion = 1;
+
+    int formatVersion = currentFormatVersion;
+    int numDocs = 0;
+    bool stemming = false;
+    bool stopwords = false;
+    bool positions = false; // final_positions.dat present (phrase/proximity queries)
+    int shards = 0;         // > 0: the index lives in shard_<i>/ subdirectories (see ShardCoordinator.h)
+    int tier1Postings = 0;  // > 0: pruned tier 1 with this many postings per term (see StaticPruning.h)
+
+    // Manifest matching the preprocessing options this binary was compiled with
+    static IndexManifest forCurrentBuild(int numDocs);
+
+    // Reads/writes manifest.dat in the index directory
+    bool load(const std::string& indexPath);
+    bool save(const std::string& indexPath) const;
+
+    // Checks that this binary can query the index; fills error otherwise
+    bool isCompatible(std::string& error) const;
+};
+
+#endif // INDEX_MANIFEST_H
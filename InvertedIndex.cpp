@@ -1,5 +1,9 @@
 #include "InvertedIndex.h"
 #include "utils.h"
+#include "IndexManifest.h"
+#include "QueryParser.h"
+#include "QueryCursor.h"
+#include "Metrics.h"
 #include <sstream>
 #include <fstream>
 #include <iostream>
@@ -11,6 +15,125 @@
 #include <algorithm>
 #include <unordered_set>
 #include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <queue>
+#include <thread>
+
+namespace {
+
+// Files of the main index that purgeMainIndex rewrites
+const char* const purgedFiles[] = {
+    "final_index.dat", "final_lexicon.dat", "final_doclengths.dat", "final_docid_to_docno.dat",
+    "final_positions.dat", "final_positions_lexicon.dat",
+};
+
+// Moves a fully written purge into place. The marker makes this resumable, so a crash between
+// the renames is finished by the next load or purge instead of leaving a mixed index behind.
+void completePurge(const std::string& indexPath) {
+    std::string purgePath = indexPath + "/purge_tmp";
+    if (!std::filesystem::exists(purgePath + "/complete")) {
+        std::filesystem::remove_all(purgePath);
+        return;
+    }
+    for (const char* file : purgedFiles) {
+        if (std::filesystem::exists(purgePath + "/" + file)) {
+            std::filesystem::rename(purgePath + "/" + file, indexPath + "/" + file);
+        }
+    }
+    std::filesystem::remove_all(purgePath);
+}
+
+// Chunks are written in term order; offsets_chunk_<i>.dat lists every chunkOffsetInterval-th term
+// with the byte offsets of its lines in index_chunk_<i>.dat and positions_chunk_<i>.dat
+const int chunkOffsetInterval = 128;
+
+// Byte offsets at which a merge of terms >= first starts reading a chunk
+std::pair<uint64_t, uint64_t> chunkStartOffsets(const std::string& indexPath, int chunkID, const std::string& first) {
+    std::pair<uint64_t, uint64_t> offsets = {0, 0};
+    if (first.empty()) return offsets;
+
+    std::ifstream offsetsFile(indexPath + "/offsets_chunk_" + std::to_string(chunkID) + ".dat");
+    std::string term;
+    uint64_t indexOffset, positionsOffset;
+    while (offsetsFile >> term >> indexOffset >> positionsOffset && term <= first) {
+        offsets = {indexOffset, positionsOffset};
+    }
+    return offsets;
+}
+
+// Reads the lines of a file from a byte offset on. No descriptor is held between refills, so a
+// merge can stream from any number of chunks at once.
+class ChunkLineReader {
+public:
+    ChunkLineReader(std::string path, uint64_t offset) : path(std::move(path)), fileOffset(offset) {}
+
+    bool readLine(std::string& line) {
+        line.clear();
+        while (true) {
+            size_t newline = buffer.find('\n', bufferPos);
+            if (newline != std::string::npos) {
+                line.append(buffer, bufferPos, newline - bufferPos);
+                bufferPos = newline + 1;
+                return true;
+            }
+            line.append(buffer, bufferPos, std::string::npos);
+            buffer.clear();
+            bufferPos = 0;
+            if (atEnd) return !line.empty();
+
+            std::ifstream file(path, std::ios::binary);
+            file.seekg(fileOffset);
+            buffer.resize(refillBytes);
+            file.read(&buffer[0], refillBytes);
+            buffer.resize(file ? refillBytes : static_cast<size_t>(std::max<std::streamsize>(0, file.gcount())));
+            fileOffset += buffer.size();
+            atEnd = buffer.size() < refillBytes;
+        }
+    }
+
+private:
+    static const size_t refillBytes = 16384;
+    std::string path;
+    uint64_t fileOffset; // Where the next refill starts
+    std::string buffer;
+    size_t bufferPos = 0;
+    bool atEnd = false;
+};
+
+} // namespace
+
+
+// Parses one "<term> <n> <docIDs...> <freqs...>" line of an index file
+bool InvertedIndex::parsePostingsLine(const std::string& line, std::wstring& wterm, std::vector<Posting>& postings) {
+    std::istringstream iss(line);
+    std::string term;
+    int numPostings;
+
+    postings.clear();
+    wterm.clear();
+    if (!(iss >> term >> numPostings) || numPostings < 0) return false;
+
+    wterm = utf8ToWstring(term);
+    postings.resize(numPostings);
+
+    // Read docIDs, then frequencies
+    for (int i = 0; i < numPostings; ++i) {
+        if (!(iss >> postings[i].docID)) {
+            postings.clear();
+            return false;
+        }
+    }
+    for (int i = 0; i < numPostings; ++i) {
+        if (!(iss >> postings[i].frequency)) {
+            postings.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
 
 int InvertedIndex::estimateChunkSize() {
     return 1000000; // Manually set chunk size 
@@ -38,9 +161,13 @@ void InvertedIndex::buildIndexSPIMI(const std::unordered_map<int, std::wstring>&
         int docID = doc.first;
         if (doc.second.empty()) continue; // Skip empty documents
 
+        METRIC_STAGE(Tokenize);
+        METRIC_ADD(DocsTokenized, 1);
+
         std::wstringstream wss(doc.second);
         std::wstring word;
         std::unordered_map<std::wstring, int> termFrequency;
+        std::unordered_map<std::wstring, std::vector<int>> termPositions;
         int docLength = 0;
 
         while (wss >> word) {
@@ -49,6 +176,7 @@ void InvertedIndex::buildIndexSPIMI(const std::unordered_map<int, std::wstring>&
                 if (word.empty()) continue;
 
                 termFrequency[word]++;
+                if (positional) termPositions[word].push_back(docLength);
                 docLength++;
             } catch (const std::exception& e) {
                 std::cerr << " Error processing word in DocID: " << docID << ", Error: " << e.what() << std::endl;
@@ -61,9 +189,14 @@ void InvertedIndex::buildIndexSPIMI(const std::unordered_map<int, std::wstring>&
         for (const auto& term : termFrequency) {
             partialIndex[term.first].push_back({docID, term.second});
         }
+        METRIC_ADD(SpimiInserts, termFrequency.size());
+
+        for (auto& term : termPositions) {
+            partialPositions[term.first][docID] = std::move(term.second);
+        }
 
         docLengths[docID] = docLength;
-        docIDToDocno[docID] = docID;
+        docIDToDocno.emplace(docID, docID); // Keeps a docno preset by updateDocument
 
         processedDocs++;
 
@@ -71,12 +204,14 @@ void InvertedIndex::buildIndexSPIMI(const std::unordered_map<int, std::wstring>&
         if (processedDocs % chunkSize == 0) {
             savePartialIndex(partialIndex, chunkCounter++, indexPath);
             partialIndex.clear();
+            partialPositions.clear();
         }
     }
 
     //  Save the last remaining chunk if not empty
     if (!partialIndex.empty()) {
         savePartialIndex(partialIndex, chunkCounter, indexPath);
+        partialPositions.clear();
     }
 
     auto end = std::chrono::high_resolution_clock::now();
@@ -87,6 +222,9 @@ void InvertedIndex::buildIndexSPIMI(const std::unordered_map<int, std::wstring>&
 
 
 void InvertedIndex::savePartialIndex(const std::unordered_map<std::wstring, std::vector<Posting>>& partialIndex, int chunkID, const std::string& indexPath) {
+    METRIC_STAGE(ChunkWrite);
+    METRIC_ADD(ChunksWritten, 1);
+
     std::string indexFilePath = indexPath + "/index_chunk_" + std::to_string(chunkID) + ".dat";
     std::string docLengthsPath = indexPath + "/doclengths_chunk_" + std::to_string(chunkID) + ".dat";
     std::string lexiconPath = indexPath + "/lexicon_chunk_" + std::to_string(chunkID) + ".dat";
@@ -103,24 +241,34 @@ void InvertedIndex::savePartialIndex(const std::unordered_map<std::wstring, std:
     }
 
     std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-    std::unordered_set<std::wstring> uniqueTerms;
+
+    // Terms go out in UTF-8 byte order, the order of the final index, so each merge range can
+    // seek to its first term through the offsets table and stop at its upper bound
+    std::vector<std::pair<std::string, const std::wstring*>> sortedTerms;
+    sortedTerms.reserve(partialIndex.size());
+    for (const auto& entry : partialIndex) sortedTerms.push_back({converter.to_bytes(entry.first), &entry.first});
+    std::sort(sortedTerms.begin(), sortedTerms.end());
+
+    std::ofstream positionsFile;
+    if (positional) positionsFile.open(indexPath + "/positions_chunk_" + std::to_string(chunkID) + ".dat");
+    std::ofstream offsetsFile(indexPath + "/offsets_chunk_" + std::to_string(chunkID) + ".dat");
 
     // Write partial index with grouped docIDs and frequencies
-    std::unordered_map<std::wstring, std::unordered_set<int>> termDocIDCheck;
-    for (const auto& entry : partialIndex) {
-        std::wstring term = entry.first;
+    size_t numTerms = 0;
+    for (const auto& [utf8Term, term] : sortedTerms) {
         std::vector<Posting> uniquePostings;
-
-        for (const auto& posting : entry.second) {
-            if (termDocIDCheck[term].find(posting.docID) == termDocIDCheck[term].end()) {
-                termDocIDCheck[term].insert(posting.docID);
-                uniquePostings.push_back(posting);
-            }
+        std::unordered_set<int> seenDocIDs;
+        for (const auto& posting : partialIndex.at(*term)) {
+            if (seenDocIDs.insert(posting.docID).second) uniquePostings.push_back(posting);
         }
 
         if (uniquePostings.empty()) continue;
 
-        indexFile << converter.to_bytes(term) << " " << uniquePostings.size() << " ";
+        if (numTerms++ % chunkOffsetInterval == 0) {
+            offsetsFile << utf8Term << " " << indexFile.tellp() << " " << (positional ? positionsFile.tellp() : std::streampos(0)) << "\n";
+        }
+
+        indexFile << utf8Term << " " << uniquePostings.size() << " ";
 
         // Write docIDs
         for (const auto& posting : uniquePostings) {
@@ -134,12 +282,20 @@ void InvertedIndex::savePartialIndex(const std::unordered_map<std::wstring, std:
 
         indexFile << "\n";
 
-        uniqueTerms.insert(term);
-    }
+        // Positions line by line with the postings, as "<term> <n> (<docID> <count> <positions...>)*"
+        if (positional) {
+            auto docPositions = partialPositions.find(*term);
+            positionsFile << utf8Term << " " << (docPositions != partialPositions.end() ? docPositions->second.size() : 0);
+            if (docPositions != partialPositions.end()) {
+                for (const auto& [docID, positions] : docPositions->second) {
+                    positionsFile << " " << docID << " " << positions.size();
+                    for (int position : positions) positionsFile << " " << position;
+                }
+            }
+            positionsFile << "\n";
+        }
 
-    // Write the lexicon file
-    for (const auto& term : uniqueTerms) {
-        lexiconFile << converter.to_bytes(term) << "\n";
+        lexiconFile << utf8Term << "\n";
     }
 
     // Write document lengths
@@ -161,72 +317,217 @@ void InvertedIndex::savePartialIndex(const std::unordered_map<std::wstring, std:
     // Debugging Output
     std::cout << "Saved chunk " << chunkID << " to disk: " << indexFilePath << std::endl;
     std::cout << "Saved docLengths with size: " << docLengths.size() << std::endl;
-    std::cout << "Saved lexicon with size: " << uniqueTerms.size() << std::endl;
+    std::cout << "Saved lexicon with size: " << numTerms << std::endl;
     std::cout << "Saved docIDToDocno with size: " << docIDToDocno.size() << std::endl;
 }
 
 
 
 void InvertedIndex::mergeIndexes(int numChunks, const std::string& indexPath) {
+    METRIC_STAGE(Merge);
     std::cout << " Merging " << numChunks << " index chunks into final index...\n";
 
-    std::ofstream finalIndexFile(indexPath + "/final_index.dat");
-    std::ofstream finalDocLengthsFile(indexPath + "/final_doclengths.dat");
-    std::ofstream finalDocIDToDocnoFile(indexPath + "/final_docid_to_docno.dat");
-    std::ofstream finalLexiconFile(indexPath + "/final_lexicon.dat");
-
-    if (!finalIndexFile || !finalDocLengthsFile || !finalDocIDToDocnoFile || !finalLexiconFile) {
-        std::cerr << "ERROR: Failed to open final index files for writing!" << std::endl;
-        return;
+    // Split points: quantiles of the chunk lexicons, so every range gets a similar share of terms
+    std::vector<std::string> sample;
+    for (int i = 0; i < numChunks; ++i) {
+        std::ifstream lexiconChunk(indexPath + "/lexicon_chunk_" + std::to_string(i) + ".dat");
+        std::string term;
+        while (lexiconChunk >> term) sample.push_back(term);
+    }
+    std::sort(sample.begin(), sample.end());
+    sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+
+    int hardwareThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int numParts = std::max(1, std::min(hardwareThreads, static_cast<int>(sample.size() / minTermsPerMergePart)));
+    std::vector<std::string> bounds; // Part p holds terms in [bounds[p - 1], bounds[p]); first and last are open
+    for (int p = 1; p < numParts; ++p) {
+        bounds.push_back(sample[sample.size() * p / numParts]);
+    }
+    sample.clear();
+
+    // Each range is merged into its own part files by its own thread; the doc tables are
+    // concatenated concurrently by two more
+    std::vector<std::thread> workers;
+    std::vector<char> partOK(numParts, 0);
+    for (int p = 0; p < numParts; ++p) {
+        std::string first = (p == 0) ? "" : bounds[p - 1];
+        std::string last = (p == numParts - 1) ? "" : bounds[p];
+        workers.emplace_back([&, p, first, last]() {
+            partOK[p] = mergeTermRange(numChunks, indexPath, first, last, p);
+        });
     }
 
-    std::unordered_map<std::wstring, std::vector<Posting>> termPostings;
-    std::unordered_set<std::wstring> uniqueTerms;
+    auto concatenateChunks = [numChunks, indexPath](const std::string& chunkPrefix, const std::string& finalName) {
+        std::ofstream finalFile(indexPath + "/" + finalName);
+        for (int i = 0; i < numChunks; i++) {
+            std::ifstream chunkFile(indexPath + "/" + chunkPrefix + std::to_string(i) + ".dat");
+            std::string line;
+            while (std::getline(chunkFile, line)) {
+                finalFile << line << "\n";
+            }
+        }
+    };
+    workers.emplace_back(concatenateChunks, "doclengths_chunk_", "final_doclengths.dat");
+    workers.emplace_back(concatenateChunks, "docid_to_docno_chunk_", "final_docid_to_docno.dat");
 
-    std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+    for (auto& worker : workers) worker.join();
 
-    // Read and merge postings from each chunk
-    for (int i = 0; i < numChunks; ++i) {
-        std::ifstream chunkFile(indexPath + "/index_chunk_" + std::to_string(i) + ".dat");
-        if (!chunkFile.is_open()) {
-            std::cerr << "WARNING: Could not open chunk file " << i << std::endl;
-            continue;
+    for (int p = 0; p < numParts; ++p) {
+        if (!partOK[p]) {
+            std::cerr << "ERROR: Failed to merge term range " << p << " into the final index!" << std::endl;
+            return;
         }
+    }
 
-        std::string line;
-        while (std::getline(chunkFile, line)) {
-            if (line.empty()) continue;
+    // Ranges are disjoint and ordered, so the parts are simply appended; positions offsets are
+    // relative to their part and get shifted by the bytes of the parts before it
+    std::ofstream finalIndexFile(indexPath + "/final_index.dat", std::ios::binary);
+    std::ofstream finalLexiconFile(indexPath + "/final_lexicon.dat", std::ios::binary);
+    std::ofstream finalPositionsFile;
+    std::ofstream finalPositionsLexiconFile;
+    if (positional) {
+        finalPositionsFile.open(indexPath + "/final_positions.dat", std::ios::binary);
+        finalPositionsLexiconFile.open(indexPath + "/final_positions_lexicon.dat");
+    }
+    if (!finalIndexFile || !finalLexiconFile || (positional && (!finalPositionsFile || !finalPositionsLexiconFile))) {
+        std::cerr << "ERROR: Failed to open final index files for writing!" << std::endl;
+        return;
+    }
+
+    uint64_t positionsBase = 0;
+    for (int p = 0; p < numParts; ++p) {
+        std::string suffix = ".part" + std::to_string(p);
+        for (auto [partName, finalFile] : {std::make_pair("final_index.dat", &finalIndexFile),
+                                           std::make_pair("final_lexicon.dat", &finalLexiconFile)}) {
+            std::string partPath = indexPath + "/" + partName + suffix;
+            std::ifstream partFile(partPath, std::ios::binary);
+            if (partFile.peek() != std::ifstream::traits_type::eof()) *finalFile << partFile.rdbuf();
+            partFile.close();
+            std::filesystem::remove(partPath);
+        }
 
-            std::istringstream iss(line);
+        if (positional) {
+            std::string lexiconPartPath = indexPath + "/final_positions_lexicon.dat" + suffix;
+            std::ifstream lexiconPart(lexiconPartPath);
             std::string term;
-            int numPostings;
+            uint64_t offset, length;
+            while (lexiconPart >> term >> offset >> length) {
+                finalPositionsLexiconFile << term << " " << positionsBase + offset << " " << length << "\n";
+            }
+            lexiconPart.close();
+            std::filesystem::remove(lexiconPartPath);
+
+            std::string positionsPartPath = indexPath + "/final_positions.dat" + suffix;
+            std::ifstream positionsPart(positionsPartPath, std::ios::binary);
+            if (positionsPart.peek() != std::ifstream::traits_type::eof()) finalPositionsFile << positionsPart.rdbuf();
+            positionsPart.close();
+            positionsBase += std::filesystem::file_size(positionsPartPath);
+            std::filesystem::remove(positionsPartPath);
+        }
+    }
 
-            if (!(iss >> term >> numPostings)) continue;
+    std::cout << " Final index merge completed successfully (" << numParts << " term ranges).\n";
+}
 
-            std::wstring wterm = utf8ToWstring(term);
-            std::vector<int> docIDs(numPostings);
-            std::vector<int> freqs(numPostings);
 
-            for (int j = 0; j < numPostings; ++j) iss >> docIDs[j];
-            for (int j = 0; j < numPostings; ++j) iss >> freqs[j];
+bool InvertedIndex::mergeTermRange(int numChunks, const std::string& indexPath, const std::string& first,
+                                   const std::string& last, int part) const {
+    // One cursor per chunk, positioned at its first term >= first through the offsets table
+    struct ChunkCursor {
+        std::unique_ptr<ChunkLineReader> index;
+        std::unique_ptr<ChunkLineReader> positions;
+        std::string term;
+        std::string line;
+        std::string positionsLine;
+    };
+
+    // Moves a cursor to its next line in range; false once the chunk has no more terms below last
+    auto advance = [&](ChunkCursor& cursor) {
+        while (cursor.index->readLine(cursor.line)) {
+            if (cursor.positions) cursor.positions->readLine(cursor.positionsLine);
+            if (cursor.line.empty()) continue;
+
+            cursor.term = cursor.line.substr(0, cursor.line.find(' '));
+            if (!first.empty() && cursor.term < first) continue;
+            return last.empty() || cursor.term < last;
+        }
+        return false;
+    };
 
-            for (int j = 0; j < numPostings; ++j) {
-                termPostings[wterm].push_back({docIDs[j], freqs[j]});
-            }
+    std::vector<ChunkCursor> cursors(numChunks);
+    using HeapEntry = std::pair<std::string, int>; // (term, chunk), smallest first
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+    for (int i = 0; i < numChunks; ++i) {
+        std::string chunkPath = indexPath + "/index_chunk_" + std::to_string(i) + ".dat";
+        if (!std::filesystem::exists(chunkPath)) {
+            std::cerr << "WARNING: Could not open chunk file " << i << std::endl;
+            continue;
+        }
 
-            uniqueTerms.insert(wterm);
+        auto [indexOffset, positionsOffset] = chunkStartOffsets(indexPath, i, first);
+        cursors[i].index = std::make_unique<ChunkLineReader>(chunkPath, indexOffset);
+        if (positional) {
+            cursors[i].positions = std::make_unique<ChunkLineReader>(
+                indexPath + "/positions_chunk_" + std::to_string(i) + ".dat", positionsOffset);
         }
+        if (advance(cursors[i])) heap.push({cursors[i].term, i});
+    }
 
-        chunkFile.close();
+    std::string suffix = ".part" + std::to_string(part);
+    std::ofstream indexFile(indexPath + "/final_index.dat" + suffix);
+    std::ofstream lexiconFile(indexPath + "/final_lexicon.dat" + suffix);
+    std::ofstream positionsFile;
+    std::ofstream positionsLexiconFile;
+    if (positional) {
+        positionsFile.open(indexPath + "/final_positions.dat" + suffix, std::ios::binary);
+        positionsLexiconFile.open(indexPath + "/final_positions_lexicon.dat" + suffix);
     }
+    if (!indexFile || !lexiconFile || (positional && (!positionsFile || !positionsLexiconFile))) return false;
 
-    // Merge postings per term and write final index
-    for (const auto& [term, postingsList] : termPostings) {
+    // k-way merge: each term is gathered from the chunks that hold it, in chunk order, and written
+    // before the next one is read, so only one term's postings are in memory at a time
+    while (!heap.empty()) {
+        std::string term = heap.top().first;
+
+        // Merge: docID → aggregated frequency; positions stay keyed by docID until the order is known
         std::unordered_map<int, int> mergedMap;
+        std::unordered_map<int, std::vector<int>> docPositions;
+        while (!heap.empty() && heap.top().first == term) {
+            ChunkCursor& cursor = cursors[heap.top().second];
+            int chunk = heap.top().second;
+            heap.pop();
+
+            std::istringstream iss(cursor.line);
+            std::string lineTerm;
+            int numPostings;
+            if (iss >> lineTerm >> numPostings) {
+                std::vector<int> docIDs(numPostings);
+                for (int j = 0; j < numPostings; ++j) iss >> docIDs[j];
+                for (int j = 0; j < numPostings; ++j) {
+                    int freq = 0;
+                    iss >> freq;
+                    mergedMap[docIDs[j]] += freq;
+                }
+            }
 
-        // Merge: docID → aggregated frequency
-        for (const auto& posting : postingsList) {
-            mergedMap[posting.docID] += posting.frequency;
+            if (cursor.positions) {
+                std::istringstream positionsStream(cursor.positionsLine);
+                int numDocs;
+                if (positionsStream >> lineTerm >> numDocs) {
+                    for (int j = 0; j < numDocs; ++j) {
+                        int docID, count;
+                        positionsStream >> docID >> count;
+                        auto& positions = docPositions[docID];
+                        for (int k = 0; k < count; ++k) {
+                            int position;
+                            positionsStream >> position;
+                            positions.push_back(position);
+                        }
+                    }
+                }
+            }
+
+            if (advance(cursor)) heap.push({cursor.term, chunk});
         }
 
         // Convert to Posting list
@@ -240,94 +541,88 @@ void InvertedIndex::mergeIndexes(int numChunks, const std::string& indexPath) {
             return a.docID < b.docID;
         });
 
-        // Write to final index in grouped format
-        finalIndexFile << converter.to_bytes(term) << " " << mergedPostings.size() << " ";
-        for (const auto& p : mergedPostings) finalIndexFile << p.docID << " ";
-        for (const auto& p : mergedPostings) finalIndexFile << p.frequency << " ";
-        finalIndexFile << "\n";
+        // Write in grouped format
+        indexFile << term << " " << mergedPostings.size() << " ";
+        for (const auto& p : mergedPostings) indexFile << p.docID << " ";
+        for (const auto& p : mergedPostings) indexFile << p.frequency << " ";
+        indexFile << "\n";
 
-        finalLexiconFile << converter.to_bytes(term) << "\n";
-    }
+        lexiconFile << term << "\n";
 
-    // Merge document lengths
-    for (int i = 0; i < numChunks; i++) {
-        std::ifstream dlFile(indexPath + "/doclengths_chunk_" + std::to_string(i) + ".dat");
-        std::string line;
-        while (std::getline(dlFile, line)) {
-            finalDocLengthsFile << line << "\n";
-        }
-        dlFile.close();
-    }
+        // One positions block per term, postings in the same docID order as above
+        if (positional) {
+            std::string block;
+            for (const auto& p : mergedPostings) encodePositions(docPositions[p.docID], block);
 
-    // Merge docID-to-docno mapping
-    for (int i = 0; i < numChunks; i++) {
-        std::ifstream didFile(indexPath + "/docid_to_docno_chunk_" + std::to_string(i) + ".dat");
-        std::string line;
-        while (std::getline(didFile, line)) {
-            finalDocIDToDocnoFile << line << "\n";
+            positionsLexiconFile << term << " " << positionsFile.tellp() << " " << block.size() << "\n";
+            positionsFile.write(block.data(), block.size());
         }
-        didFile.close();
     }
-
-    std::cout << " Final index merge completed successfully.\n";
+    return true;
 }
 
 
+bool InvertedIndex::loadIndex(const std::string& indexPath) {
+    METRIC_STAGE(Load);
 
+    // Finishes a purge that was interrupted after it was fully written
+    completePurge(indexPath);
 
+    if (!loadIndexFiles(indexPath)) {
+        std::cerr << " ERROR: One or more required index files are missing. Aborting index load.\n";
+        return false;
+    }
 
+    // Delta segments hold strictly larger docIDs, so appending keeps every postings list sorted
+    int nextDocID = 0;
+    std::vector<SegmentInfo> segments = readSegments(indexPath, nextDocID);
+    for (const auto& segment : segments) {
+        if (!loadIndexFiles(indexPath + "/" + segment.name)) {
+            std::cerr << " WARNING: Could not load segment " << segment.name << std::endl;
+        }
+    }
 
-void InvertedIndex::loadIndex(const std::string& indexPath) {
-    std::ifstream indexFile(indexPath + "/final_index.dat");
-    std::ifstream lexiconFile(indexPath + "/final_lexicon.dat");
-    std::ifstream docLengthsFile(indexPath + "/final_doclengths.dat");
-    std::ifstream docIDToDocnoFile(indexPath + "/final_docid_to_docno.dat");
+    // Tier 1 only covers the main index; documents of delta segments are always scored
+    loadTier1(indexPath);
+    tier1End = segments.empty() ? INT_MAX : segments.front().firstDocID;
 
-    if (!indexFile.is_open() || !lexiconFile.is_open() || !docLengthsFile.is_open() || !docIDToDocnoFile.is_open()) {
-        std::cerr << " ERROR: One or more required index files are missing. Aborting index load.\n";
-        return;
+    // Tombstones are applied at query time until a segment merge or main-index purge drops them
+    deletedDocs.load(indexPath);
+    numDeletedLoaded = 0;
+    for (const auto& entry : docLengths) {
+        if (deletedDocs.isDeleted(entry.first)) numDeletedLoaded++;
     }
+    refreshLiveDocFreqs();
 
-    std::string line;
-    while (std::getline(indexFile, line)) {
-        if (line.empty()) continue;
-
-        std::istringstream iss(line);
-        std::string term;
-        int numPostings;
+    std::cout << "Index successfully loaded from disk (" << segments.size() << " delta segments, "
+              << numDeletedLoaded << " deleted documents)." << std::endl;
+    return true;
+}
 
-        // Step 1: Get term and how many docs it's in
-        
-        if (!(iss >> term >> numPostings)) continue;
 
-        std::wstring wterm = utf8ToWstring(term);
-        std::vector<int> docIDs(numPostings);
-        std::vector<int> freqs(numPostings);
+bool InvertedIndex::loadIndexFiles(const std::string& dir) {
+    std::ifstream indexFile(dir + "/final_index.dat");
+    std::ifstream lexiconFile(dir + "/final_lexicon.dat");
+    std::ifstream docLengthsFile(dir + "/final_doclengths.dat");
+    std::ifstream docIDToDocnoFile(dir + "/final_docid_to_docno.dat");
 
-        // Read docIDs
-        for (int i = 0; i < numPostings; ++i) {
-            if (!(iss >> docIDs[i])) {
-                std::cerr << " ERROR reading docID for term: " << term << std::endl;
-                break;
-            }
-        }
+    if (!indexFile.is_open() || !lexiconFile.is_open() || !docLengthsFile.is_open() || !docIDToDocnoFile.is_open()) {
+        return false;
+    }
 
-        // Read frequencies
-        for (int i = 0; i < numPostings; ++i) {
-            if (!(iss >> freqs[i])) {
-                std::cerr << " ERROR reading frequency for term: " << term << std::endl;
-                break;
-            }
-        }
+    std::string line;
+    std::wstring wterm;
+    std::vector<Posting> postings;
+    while (std::getline(indexFile, line)) {
+        if (line.empty()) continue;
 
-        // Combine into postings
-        std::vector<Posting> postings;
-        for (int i = 0; i < numPostings; ++i) {
-            postings.push_back({docIDs[i], freqs[i]});
+        if (!parsePostingsLine(line, wterm, postings)) {
+            std::cerr << " ERROR reading postings for term: " << wstringToUtf8(wterm) << std::endl;
         }
 
         if (!postings.empty()) {
-            index[wterm] = postings;
+            auto& termPostings = index[wterm];
+            termPostings.insert(termPostings.end(), postings.begin(), postings.end());
         }
     }
 
@@ -349,11 +644,645 @@ void InvertedIndex::loadIndex(const std::string& indexPath) {
         }
     }
 
-    std::cout << "Index successfully loaded from disk." << std::endl;
+    // Only the positions lexicon is kept in memory; blocks are read per phrase query
+    PositionsFile positionsFile;
+    if (positionsFile.load(dir)) {
+        positionSources.push_back(std::move(positionsFile));
+    }
+
+    return true;
+}
+
+
+// -------------------- Incremental Segments --------------------
+int InvertedIndex::countChunks(const std::string& indexPath) {
+    int numChunks = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(indexPath)) {
+        if (entry.path().filename().string().find("index_chunk_") != std::string::npos) {
+            numChunks++;
+        }
+    }
+    return numChunks;
+}
+
+
+std::vector<SegmentInfo> InvertedIndex::readSegments(const std::string& indexPath, int& nextDocID) {
+    std::vector<SegmentInfo> segments;
+    std::ifstream segmentsFile(indexPath + "/segments.dat");
+
+    if (!segmentsFile.is_open()) {
+        // Index built before segments existed: continue after the largest docID of the main index
+        nextDocID = 0;
+        std::ifstream docIDToDocnoFile(indexPath + "/final_docid_to_docno.dat");
+        int docID, docno;
+        while (docIDToDocnoFile >> docID >> docno) {
+            nextDocID = std::max(nextDocID, docID + 1);
+        }
+        return segments;
+    }
+
+    std::string key;
+    segmentsFile >> key >> nextDocID;
+
+    SegmentInfo segment;
+    while (segmentsFile >> segment.name >> segment.firstDocID >> segment.numDocs) {
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+
+void InvertedIndex::writeSegments(const std::string& indexPath, const std::vector<SegmentInfo>& segments, int nextDocID) {
+    // Write to a temporary file first so a crash never leaves a truncated segment list
+    std::string tmpPath = indexPath + "/segments.dat.tmp";
+    {
+        std::ofstream segmentsFile(tmpPath);
+        if (!segmentsFile.is_open()) {
+            std::cerr << " ERROR: Could not write segment list in " << indexPath << std::endl;
+            return;
+        }
+        segmentsFile << "next_docid " << nextDocID << "\n";
+        for (const auto& segment : segments) {
+            segmentsFile << segment.name << " " << segment.firstDocID << " " << segment.numDocs << "\n";
+        }
+    }
+    std::filesystem::rename(tmpPath, indexPath + "/segments.dat");
+}
+
+
+// Picks an unused segment_<n> directory name
+static std::string nextSegmentName(const std::vector<SegmentInfo>& segments) {
+    int segmentID = 0;
+    for (const auto& segment : segments) {
+        segmentID = std::max(segmentID, std::stoi(segment.name.substr(std::string("segment_").size())) + 1);
+    }
+    return "segment_" + std::to_string(segmentID);
+}
+
+
+bool InvertedIndex::appendSegment(const std::unordered_map<int, std::wstring>& documents, const std::string& indexPath,
+                                  const std::unordered_map<int, int>& docnos) {
+    if (documents.empty()) {
+        std::cout << " No documents to append.\n";
+        return true;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int nextDocID = 0;
+    std::vector<SegmentInfo> segments = readSegments(indexPath, nextDocID);
+
+    int minDocID = documents.begin()->first;
+    int maxDocID = minDocID;
+    for (const auto& doc : documents) {
+        minDocID = std::min(minDocID, doc.first);
+        maxDocID = std::max(maxDocID, doc.first);
+    }
+
+    if (minDocID < nextDocID) {
+        std::cerr << " ERROR: Batch docIDs must start at " << nextDocID << " or later, got " << minDocID << std::endl;
+        return false;
+    }
+
+    // Build the batch exactly like a full index, but inside its own directory. A directory of that
+    // name is not in segments.dat, so it is debris of a crashed append or merge and must not leak
+    // stale chunks into this one.
+    std::string name = nextSegmentName(segments);
+    std::string segmentPath = indexPath + "/" + name;
+    std::filesystem::remove_all(segmentPath);
+    std::filesystem::create_directories(segmentPath);
+
+    IndexManifest manifest;
+    bool hasManifest = manifest.load(indexPath);
+
+    InvertedIndex builder;
+    builder.docIDToDocno = docnos;
+    builder.setPositional(hasManifest && manifest.positions);
+    builder.buildIndexSPIMI(documents, estimateChunkSize(), segmentPath);
+
+    int numChunks = countChunks(segmentPath);
+    if (numChunks == 0) {
+        std::cerr << " ERROR: No index chunks produced for segment " << name << std::endl;
+        std::filesystem::remove_all(segmentPath);
+        return false;
+    }
+    builder.mergeIndexes(numChunks, segmentPath);
+
+    // Chunk files are only needed until the segment is merged
+    for (const auto& entry : std::filesystem::directory_iterator(segmentPath)) {
+        if (entry.path().filename().string().find("_chunk_") != std::string::npos) {
+            std::filesystem::remove(entry.path());
+        }
+    }
+
+    segments.push_back({name, minDocID, maxDocID - minDocID + 1});
+    writeSegments(indexPath, segments, maxDocID + 1);
+
+    if (hasManifest) {
+        manifest.numDocs += static_cast<int>(documents.size());
+        manifest.save(indexPath);
+    }
+
+    // A loaded index serves the new documents right away; merging below does not change its contents
+    if (!docLengths.empty()) {
+        loadIndexFiles(segmentPath);
+        refreshLiveDocFreqs();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << " Appended " << documents.size() << " documents as " << name << " in " << elapsed.count() << " seconds.\n";
+
+    mergeSegments(indexPath);
+    return true;
+}
+
+
+void InvertedIndex::mergeSegments(const std::string& indexPath) {
+    int nextDocID = 0;
+    std::vector<SegmentInfo> segments = readSegments(indexPath, nextDocID);
+
+    DeletedDocs deleted;
+    deleted.load(indexPath);
+
+    // Tier 0 holds segments below segmentTierBase docs, each further tier is segmentMergeFactor times larger
+    auto tierOf = [](int numDocs) {
+        int tier = 0;
+        long long bound = segmentTierBase;
+        while (numDocs >= bound) {
+            tier++;
+            bound *= segmentMergeFactor;
+        }
+        return tier;
+    };
+
+    bool merged = true;
+    while (merged) {
+        merged = false;
+
+        // Only adjacent segments are merged so that each segment keeps a contiguous docID range
+        size_t runStart = 0;
+        for (size_t i = 1; i <= segments.size(); ++i) {
+            if (i < segments.size() && tierOf(segments[i].numDocs) == tierOf(segments[runStart].numDocs)) continue;
+
+            if (i - runStart >= static_cast<size_t>(segmentMergeFactor)) {
+                auto start = std::chrono::high_resolution_clock::now();
+
+                std::vector<std::string> dirs;
+                SegmentInfo mergedSegment{nextSegmentName(segments), segments[runStart].firstDocID, 0};
+                for (size_t j = runStart; j < i; ++j) {
+                    dirs.push_back(indexPath + "/" + segments[j].name);
+                    mergedSegment.numDocs = segments[j].firstDocID + segments[j].numDocs - mergedSegment.firstDocID;
+                }
+
+                mergeSegmentFiles(dirs, indexPath + "/" + mergedSegment.name, deleted);
+
+                segments.erase(segments.begin() + runStart, segments.begin() + i);
+                segments.insert(segments.begin() + runStart, mergedSegment);
+                writeSegments(indexPath, segments, nextDocID);
+
+                // Old segments are removed only after the new list is on disk
+                for (const auto& dir : dirs) {
+                    std::filesystem::remove_all(dir);
+                }
+
+                auto end = std::chrono::high_resolution_clock::now();
+                std::chrono::duration<double> elapsed = end - start;
+                std::cout << " Merged " << dirs.size() << " segments into " << mergedSegment.name
+                          << " (" << mergedSegment.numDocs << " docs) in " << elapsed.count() << " seconds.\n";
+
+                merged = true;
+                break;
+            }
+            runStart = i;
+        }
+    }
+}
+
+
+void InvertedIndex::mergeSegmentFiles(const std::vector<std::string>& dirs, const std::string& outDir, const DeletedDocs& deleted) {
+    // outDir is not listed yet, so anything already there is left over from an interrupted run
+    std::filesystem::remove_all(outDir);
+    std::filesystem::create_directories(outDir);
+
+    std::ofstream finalIndexFile(outDir + "/final_index.dat");
+    std::ofstream finalDocLengthsFile(outDir + "/final_doclengths.dat");
+    std::ofstream finalDocIDToDocnoFile(outDir + "/final_docid_to_docno.dat");
+    std::ofstream finalLexiconFile(outDir + "/final_lexicon.dat");
+
+    if (!finalIndexFile || !finalDocLengthsFile || !finalDocIDToDocnoFile || !finalLexiconFile) {
+        std::cerr << "ERROR: Failed to open merged segment files for writing!" << std::endl;
+        return;
+    }
+
+    // Segments are visited in docID order, so concatenating their lists keeps postings sorted.
+    // Postings and table entries of deleted documents are purged here.
+    std::map<std::wstring, std::vector<Posting>> termPostings;
+    std::map<int, int> mergedDocLengths;
+    std::map<int, int> mergedDocIDToDocno;
+    std::unordered_map<std::wstring, std::string> termPositionBlocks;
+
+    bool mergePositions = !dirs.empty();
+    for (const auto& dir : dirs) {
+        mergePositions = mergePositions && std::filesystem::exists(dir + "/final_positions_lexicon.dat");
+    }
+
+    for (const auto& dir : dirs) {
+        PositionsFile positionsFile;
+        std::ifstream positionsData;
+        if (mergePositions) {
+            positionsFile.load(dir);
+            positionsData.open(positionsFile.path, std::ios::binary);
+        }
+
+        std::ifstream indexFile(dir + "/final_index.dat");
+        std::string line;
+        std::wstring wterm;
+        std::vector<Posting> postings;
+        while (std::getline(indexFile, line)) {
+            if (line.empty() || !parsePostingsLine(line, wterm, postings)) continue;
+
+            // Re-encode positions posting by posting so deleted documents drop out of both streams
+            std::unique_ptr<PositionListReader> positionsReader;
+            if (mergePositions) {
+                auto block = positionsFile.blocks.find(wterm);
+                std::string bytes;
+                if (block != positionsFile.blocks.end()) {
+                    bytes.resize(block->second.second);
+                    positionsData.seekg(block->second.first);
+                    positionsData.read(&bytes[0], bytes.size());
+                }
+                positionsReader = std::make_unique<PositionListReader>(std::move(bytes));
+            }
+
+            auto& merged = termPostings[wterm];
+            for (size_t i = 0; i < postings.size(); ++i) {
+                if (deleted.isDeleted(postings[i].docID)) continue;
+                merged.push_back(postings[i]);
+                if (positionsReader) encodePositions(positionsReader->positionsAt(i), termPositionBlocks[wterm]);
+            }
+        }
+
+        std::ifstream docLengthsFile(dir + "/final_doclengths.dat");
+        int docID, value;
+        while (docLengthsFile >> docID >> value) {
+            if (!deleted.isDeleted(docID)) mergedDocLengths[docID] = value;
+        }
+
+        std::ifstream docIDToDocnoFile(dir + "/final_docid_to_docno.dat");
+        while (docIDToDocnoFile >> docID >> value) {
+            if (!deleted.isDeleted(docID)) mergedDocIDToDocno[docID] = value;
+        }
+    }
+
+    std::ofstream finalPositionsFile;
+    std::ofstream finalPositionsLexiconFile;
+    if (mergePositions) {
+        finalPositionsFile.open(outDir + "/final_positions.dat", std::ios::binary);
+        finalPositionsLexiconFile.open(outDir + "/final_positions_lexicon.dat");
+    }
+
+    for (const auto& [term, postings] : termPostings) {
+        if (postings.empty()) continue; // Every posting belonged to a deleted document
+
+        std::string utf8Term = wstringToUtf8(term);
+        finalIndexFile << utf8Term << " " << postings.size() << " ";
+        for (const auto& p : postings) finalIndexFile << p.docID << " ";
+        for (const auto& p : postings) finalIndexFile << p.frequency << " ";
+        finalIndexFile << "\n";
+
+        finalLexiconFile << utf8Term << "\n";
+
+        if (mergePositions) {
+            const std::string& block = termPositionBlocks[term];
+            finalPositionsLexiconFile << utf8Term << " " << finalPositionsFile.tellp() << " " << block.size() << "\n";
+            finalPositionsFile.write(block.data(), block.size());
+        }
+    }
+
+    for (const auto& [docID, docLength] : mergedDocLengths) {
+        finalDocLengthsFile << docID << " " << docLength << "\n";
+    }
+
+    for (const auto& [docID, docno] : mergedDocIDToDocno) {
+        finalDocIDToDocnoFile << docID << " " << docno << "\n";
+    }
 }
 
 
+// -------------------- Two-Tier Search --------------------
+void InvertedIndex::loadTier1(const std::string& indexPath) {
+    tier1.clear();
+    std::ifstream tierFile(indexPath + "/tier1_index.dat");
+    if (!tierFile.is_open()) return;
 
+    std::string line;
+    std::wstring term;
+    std::vector<Posting> postings;
+    while (std::getline(tierFile, line)) {
+        if (line.empty() || !parsePostingsLine(line, term, postings)) continue;
+        tier1[term].postings = postings;
+    }
+
+    std::ifstream cutoffsFile(indexPath + "/tier1_cutoffs.dat");
+    std::string utf8Term;
+    int cutoffFreq;
+    while (cutoffsFile >> utf8Term >> cutoffFreq) {
+        auto it = tier1.find(utf8ToWstring(utf8Term));
+        if (it != tier1.end()) it->second.cutoffFreq = cutoffFreq;
+    }
+    std::cout << "Loaded tier 1 with " << tier1.size() << " terms." << std::endl;
+}
+
+
+bool InvertedIndex::searchTier1(const std::vector<std::wstring>& terms, bool conjunctive, std::vector<SearchResult>& results) const {
+    results.clear();
+
+    // Same terms, in the same order, as the full scan, so every score is summed identically
+    std::vector<const std::vector<Posting>*> lists;
+    std::vector<int> docFreqs;
+    std::vector<int> candidates;
+    double prunedBound = 0.0;  // Highest score a document missing from every tier 1 list can reach
+    bool complete = false;     // Conjunctive: some list is complete, so tier 1 holds every match
+    {
+        METRIC_STAGE(PostingLookup);
+        for (const auto& term : terms) {
+            METRIC_ADD(TermLookups, 1);
+            auto it = index.find(term);
+            if (it == index.end()) {
+                METRIC_ADD(TermMisses, 1);
+                if (conjunctive) return true;
+                continue;
+            }
+            auto tier = tier1.find(term);
+            if (tier == tier1.end()) return false;
+
+            int docFreq = documentFrequency(term, it->second);
+            lists.push_back(&it->second);
+            docFreqs.push_back(docFreq);
+
+            for (const auto& posting : tier->second.postings) candidates.push_back(posting.docID);
+            METRIC_ADD(PostingsScanned, tier->second.postings.size());
+
+            // Delta segment documents are not in tier 1, so they are always candidates
+            auto uncovered = std::lower_bound(it->second.begin(), it->second.end(), tier1End,
+                                              [](const Posting& p, int docID) { return p.docID < docID; });
+            for (; uncovered != it->second.end(); ++uncovered) candidates.push_back(uncovered->docID);
+
+            if (tier->second.cutoffFreq == 0) complete = true;
+            else prunedBound += computeTFIDF(tier->second.cutoffFreq, 0, docFreq);
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+
+    // Exact scores from the full lists by binary search
+    {
+        METRIC_STAGE(Scoring);
+        std::vector<size_t> cursors(lists.size(), 0);
+        for (int docID : candidates) {
+            if (deletedDocs.isDeleted(docID)) continue;
+
+            int totalFreq = 0;
+            double totalTFIDF = 0.0;
+            bool matchesAll = true;
+            for (size_t i = 0; i < lists.size(); ++i) {
+                const auto& postings = *lists[i];
+                cursors[i] = std::lower_bound(postings.begin() + cursors[i], postings.end(), docID,
+                                              [](const Posting& p, int target) { return p.docID < target; }) - postings.begin();
+                if (cursors[i] == postings.size() || postings[cursors[i]].docID != docID) {
+                    matchesAll = false;
+                    continue;
+                }
+                totalFreq += postings[cursors[i]].frequency;
+                totalTFIDF += computeTFIDF(postings[cursors[i]].frequency, docLengths.at(docID), docFreqs[i]);
+            }
+
+            if (conjunctive && !matchesAll) continue;
+            if (totalFreq > 0 && totalTFIDF > 0.0) results.push_back({docID, totalFreq, totalTFIDF});
+        }
+        METRIC_ADD(DocsScored, results.size());
+    }
+
+    {
+        METRIC_STAGE(Sort);
+        std::sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
+            return a.tfidf > b.tfidf || (a.tfidf == b.tfidf && a.docID < b.docID);
+        });
+    }
+
+    // Safe only if no pruned document can reach the 20th score (strictly: ties go to lower docIDs)
+    bool safe = (conjunctive && complete) || prunedBound == 0.0 ||
+                (results.size() >= 20 && results[19].tfidf > prunedBound);
+    if (!safe && tierMode != TierMode::Unsafe) return false;
+
+    if (verbose) {
+        std::wcout << L"TF-IDF Results Count: " << results.size() << L" (tier 1, " << candidates.size() << L" candidates)" << std::endl;
+        if (results.empty()) {
+            std::wcout << L"No documents found matching the query!" << std::endl;
+        }
+    }
+    if (results.size() > 20) results.resize(20);
+    return true;
+}
+
+
+// -------------------- Global Statistics --------------------
+bool InvertedIndex::loadGlobalStats(const std::string& path) {
+    std::ifstream statsFile(path);
+    if (!statsFile.is_open()) {
+        std::cerr << " ERROR: Could not open global statistics " << path << std::endl;
+        return false;
+    }
+
+    std::string key;
+    if (!(statsFile >> key >> globalNumDocs) || key != "num_docs") {
+        std::cerr << " ERROR: Malformed global statistics " << path << std::endl;
+        globalNumDocs = 0;
+        return false;
+    }
+
+    // Only terms this shard holds can ever be scored here
+    std::string term;
+    int docFreq;
+    while (statsFile >> term >> docFreq) {
+        std::wstring wterm = utf8ToWstring(term);
+        if (index.count(wterm)) globalDocFreqs[wterm] = docFreq;
+    }
+    return true;
+}
+
+
+// -------------------- Deletions and Updates --------------------
+std::vector<int> InvertedIndex::docIDsOfDocno(int docno, const std::string& indexPath) const {
+    // Use the loaded doc table when serving, otherwise read only the docno tables from disk
+    std::vector<int> docIDs;
+    if (!docIDToDocno.empty()) {
+        for (const auto& [docID, mappedDocno] : docIDToDocno) {
+            if (mappedDocno == docno) docIDs.push_back(docID);
+        }
+    } else {
+        int nextDocID = 0;
+        std::vector<std::string> dirs = {indexPath};
+        for (const auto& segment : readSegments(indexPath, nextDocID)) {
+            dirs.push_back(indexPath + "/" + segment.name);
+        }
+        for (const auto& dir : dirs) {
+            std::ifstream docIDToDocnoFile(dir + "/final_docid_to_docno.dat");
+            int docID, mappedDocno;
+            while (docIDToDocnoFile >> docID >> mappedDocno) {
+                if (mappedDocno == docno) docIDs.push_back(docID);
+            }
+        }
+    }
+    return docIDs;
+}
+
+
+bool InvertedIndex::tombstone(const std::vector<int>& docIDs, const std::string& indexPath) {
+    deletedDocs.load(indexPath);
+
+    int numTombstoned = 0;
+    for (int docID : docIDs) {
+        if (deletedDocs.markDeleted(docID)) {
+            numTombstoned++;
+            if (docLengths.count(docID)) numDeletedLoaded++;
+        }
+    }
+    if (numTombstoned == 0 || !deletedDocs.save(indexPath)) return false;
+
+    // The manifest counts live documents: appends add to it, deletions subtract
+    IndexManifest manifest;
+    if (manifest.load(indexPath)) {
+        manifest.numDocs = std::max(0, manifest.numDocs - numTombstoned);
+        manifest.save(indexPath);
+    }
+
+    if (!docLengths.empty()) refreshLiveDocFreqs();
+    return true;
+}
+
+
+bool InvertedIndex::deleteDocument(int docno, const std::string& indexPath) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (!tombstone(docIDsOfDocno(docno, indexPath), indexPath)) {
+        std::cerr << " No live document with docno " << docno << " found." << std::endl;
+        return false;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << " Deleted docno " << docno << " in " << elapsed.count() << " seconds.\n";
+
+    purgeMainIndex(indexPath);
+    return true;
+}
+
+
+bool InvertedIndex::updateDocument(int docno, const std::wstring& text, const std::string& indexPath) {
+    // Old versions are collected before the new one exists, and only tombstoned once it does
+    std::vector<int> oldDocIDs = docIDsOfDocno(docno, indexPath);
+
+    int nextDocID = 0;
+    readSegments(indexPath, nextDocID);
+    if (!appendSegment({{nextDocID, text}}, indexPath, {{nextDocID, docno}})) {
+        std::cerr << " ERROR: Could not index the new version of docno " << docno << "; the old one stays live." << std::endl;
+        return false;
+    }
+
+    // An unknown docno makes the update an insert
+    if (!oldDocIDs.empty() && !tombstone(oldDocIDs, indexPath)) {
+        std::cerr << " ERROR: Could not delete the old version of docno " << docno << std::endl;
+        return false;
+    }
+    purgeMainIndex(indexPath);
+    return true;
+}
+
+
+void InvertedIndex::purgeMainIndex(const std::string& indexPath) {
+    completePurge(indexPath);
+
+    // Main-index docIDs are those of its doc-length table (where chunks may repeat them)
+    std::unordered_set<int> mainDocIDs;
+    {
+        std::ifstream docLengthsFile(indexPath + "/final_doclengths.dat");
+        int docID, docLength;
+        while (docLengthsFile >> docID >> docLength) mainDocIDs.insert(docID);
+    }
+    DeletedDocs deleted;
+    deleted.load(indexPath);
+    size_t numDeleted = 0;
+    for (int docID : mainDocIDs) {
+        if (deleted.isDeleted(docID)) numDeleted++;
+    }
+    if (numDeleted == 0 || numDeleted < purgeDeletedRatio * mainDocIDs.size()) return;
+
+    // Same rewrite as a segment merge. Tombstones stay set, so a tier 1 that still lists purged
+    // postings keeps skipping them and its cutoffs remain upper bounds.
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string purgePath = indexPath + "/purge_tmp";
+    mergeSegmentFiles({indexPath}, purgePath, deleted);
+    for (const char* file : purgedFiles) {
+        bool optional = std::string(file).find("positions") != std::string::npos;
+        if (!optional && !std::filesystem::exists(purgePath + "/" + file)) {
+            std::cerr << " ERROR: Purging deleted documents failed; the main index is unchanged." << std::endl;
+            std::filesystem::remove_all(purgePath);
+            return;
+        }
+    }
+    std::ofstream(purgePath + "/complete").close();
+    completePurge(indexPath);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << " Purged " << numDeleted << " deleted documents from the main index in " << elapsed.count() << " seconds.\n";
+}
+
+
+int InvertedIndex::docno(int docID) const {
+    // Without a recorded mapping a document keeps docno == docID
+    auto it = docIDToDocno.find(docID);
+    return it != docIDToDocno.end() ? it->second : docID;
+}
+
+
+int InvertedIndex::liveDocCount() const {
+    if (globalNumDocs > 0) return globalNumDocs;
+    return static_cast<int>(docLengths.size()) - numDeletedLoaded;
+}
+
+
+int InvertedIndex::documentFrequency(const std::wstring& term, const std::vector<Posting>& postings) const {
+    // A shard scores with collection-wide df so its scores match a single index
+    if (globalNumDocs > 0) {
+        auto it = globalDocFreqs.find(term);
+        if (it != globalDocFreqs.end()) return it->second;
+    }
+
+    // Cached at load time; only lists that contain deleted documents have an entry
+    if (!liveDocFreqs.empty()) {
+        auto it = liveDocFreqs.find(term);
+        if (it != liveDocFreqs.end()) return it->second;
+    }
+    return static_cast<int>(postings.size());
+}
+
+
+void InvertedIndex::refreshLiveDocFreqs() {
+    liveDocFreqs.clear();
+    if (deletedDocs.empty()) return;
+
+    for (const auto& [term, postings] : index) {
+        int df = 0;
+        for (const auto& posting : postings) {
+            if (!deletedDocs.isDeleted(posting.docID)) df++;
+        }
+        if (df != static_cast<int>(postings.size())) liveDocFreqs[term] = df;
+    }
+}
 
 
 // -------------------- Optimized TF-IDF Search --------------------
@@ -363,53 +1292,78 @@ std::vector<SearchResult> InvertedIndex::searchWithTFIDF(const std::wstring& que
     std::wstring word;
     std::vector<std::wstring> terms;
 
+    METRIC_ADD(Queries, 1);
+
     // Step 1: Preprocess the query
-    while (wss >> word) {
-        word = preprocessWord(word);
-        if (!word.empty()) {
-            terms.push_back(word);
+    {
+        METRIC_STAGE(Preprocess);
+        while (wss >> word) {
+            word = preprocessWord(word);
+            if (!word.empty()) {
+                terms.push_back(word);
+            }
         }
     }
 
     if (terms.empty()) {
-        std::wcout << L"Query resulted in no valid terms after preprocessing!" << std::endl;
+        if (verbose) std::wcout << L"Query resulted in no valid terms after preprocessing!" << std::endl;
         return results;
     }
 
-    std::unordered_map<int, std::pair<int, double>> docScores;
-    std::vector<std::unordered_set<int>> docSets;
-
-    // Step 2: Iterate one term at a time
-    for (const auto& term : terms) {
-        auto it = index.find(term);
-        if (it == index.end()) {
-            if (conjunctive) return {};
-            continue;
+    // A pruned index answers from its small first tier whenever that gives the exact top 20
+    if (!tier1.empty() && tierMode != TierMode::Off) {
+        if (searchTier1(terms, conjunctive, results)) {
+            tier1Served++;
+            return results;
         }
+        tier1Fallbacks++;
+        results.clear();
+        if (verbose) std::wcout << L"Tier 1 cannot guarantee the top 20, searching the full lists" << std::endl;
+    }
 
-        openList(term);  //  Open the term’s posting list
-        std::unordered_set<int> termDocIDs;
-        int docID;
-
-        while ((docID = next()) != -1) {
-            int freq = getFreq();  // Get frequency before moving
-
-            termDocIDs.insert(docID);
+    std::unordered_map<int, std::pair<int, double>> docScores;
+    std::vector<std::unordered_set<int>> docSets;
+    std::unordered_map<std::wstring, int> termDocFreqs;
+    // (postings, df) in query order. Lists are walked with local iterators rather than
+    // openList()/next(), whose shared cursor would race between concurrent searches.
+    std::vector<std::pair<const std::vector<Posting>*, int>> foundLists;
+
+    // Step 2: Look up each term's list (and, for AND, the documents it contains)
+    {
+        METRIC_STAGE(PostingLookup);
+        for (const auto& term : terms) {
+            METRIC_ADD(TermLookups, 1);
+
+            auto it = index.find(term);
+            if (it == index.end()) {
+                METRIC_ADD(TermMisses, 1);
+                if (conjunctive) return {};
+                continue;
+            }
 
-            if (!conjunctive && docLengths.find(docID) != docLengths.end()) {
-                double tfidf = computeTFIDF(freq, docLengths.at(docID), index.at(term).size());
-                docScores[docID].first += freq;
-                docScores[docID].second += tfidf;
+            // df counts only live documents once some have been deleted
+            int docFreq = documentFrequency(term, it->second);
+            termDocFreqs[term] = docFreq;
+            foundLists.push_back({&it->second, docFreq});
+
+            if (conjunctive) {
+                std::unordered_set<int> termDocIDs;
+                for (const Posting& posting : it->second) {
+                    if (deletedDocs.isDeleted(posting.docID)) continue;
+                    termDocIDs.insert(posting.docID);
+                    METRIC_ADD(PostingsScanned, 1);
+                }
+                docSets.push_back(std::move(termDocIDs));
             }
         }
-
-        closeList();  //  Close after use
-        docSets.push_back(std::move(termDocIDs));
     }
 
     // Step 3: Handle conjunctive (AND) queries
+    std::unordered_set<int> intersection;
     if (conjunctive && !docSets.empty()) {
-        std::unordered_set<int> intersection = docSets[0];
+        METRIC_STAGE(Intersection);
+
+        intersection = docSets[0];
         for (size_t i = 1; i < docSets.size(); ++i) {
             std::unordered_set<int> temp;
             for (int docID : intersection) {
@@ -419,6 +1373,26 @@ std::vector<SearchResult> InvertedIndex::searchWithTFIDF(const std::wstring& que
             }
             intersection = std::move(temp);
         }
+    }
+
+    // Step 4: Accumulate TF-IDF, one term at a time so every score is summed in query order
+    {
+        METRIC_STAGE(Scoring);
+        if (!conjunctive) {
+            for (const auto& [postings, docFreq] : foundLists) {
+                for (const Posting& posting : *postings) {
+                    if (deletedDocs.isDeleted(posting.docID)) continue;
+                    METRIC_ADD(PostingsScanned, 1);
+
+                    auto length = docLengths.find(posting.docID);
+                    if (length != docLengths.end()) {
+                        double tfidf = computeTFIDF(posting.frequency, length->second, docFreq);
+                        docScores[posting.docID].first += posting.frequency;
+                        docScores[posting.docID].second += tfidf;
+                    }
+                }
+            }
+        }
 
         for (int docID : intersection) {
             int totalFreq = 0;
@@ -432,36 +1406,350 @@ std::vector<SearchResult> InvertedIndex::searchWithTFIDF(const std::wstring& que
 
                 if (it != postings.end()) {
                     totalFreq += it->frequency;
-                    totalTFIDF += computeTFIDF(it->frequency, docLengths.at(docID), postings.size());
+                    totalTFIDF += computeTFIDF(it->frequency, docLengths.at(docID), termDocFreqs.at(term));
                 }
             }
 
             docScores[docID] = {totalFreq, totalTFIDF};
         }
+        METRIC_ADD(DocsScored, docScores.size());
     }
 
-    // Step 4: Filter and sort results
-    for (const auto& [docID, score] : docScores) {
-        if (score.first > 0 && score.second > 0.0) {
-            results.push_back({docID, score.first, score.second});
+    // Step 5: Filter and sort results
+    {
+        METRIC_STAGE(Sort);
+        for (const auto& [docID, score] : docScores) {
+            if (score.first > 0 && score.second > 0.0) {
+                results.push_back({docID, score.first, score.second});
+            }
         }
+
+        // Ties go to the lower docID so rankings are deterministic (and identical across shards)
+        std::sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
+            return a.tfidf > b.tfidf || (a.tfidf == b.tfidf && a.docID < b.docID);
+        });
     }
 
-    std::sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
-        return a.tfidf > b.tfidf;
-    });
+    if (verbose) {
+        std::wcout << L"TF-IDF Results Count: " << results.size() << std::endl;
+        if (results.empty()) {
+            std::wcout << L"No documents found matching the query!" << std::endl;
+        }
+    }
+
+    if (results.size() > 20) results.resize(20);
+
+    return results;
+}
+
+
+
+// -------------------- Phrase and Proximity Search --------------------
+void InvertedIndex::queuePositionsReads(const std::vector<std::wstring>& terms, std::vector<std::string>& blocks,
+                                        std::vector<size_t>& readTerms, ReadBatch& batch) const {
+    blocks.assign(terms.size(), std::string());
+    readTerms.clear();
+    for (size_t i = 0; i < terms.size(); ++i) {
+        // Sized once up front: the queued reads point into the string
+        uint64_t total = 0;
+        for (const auto& source : positionSources) {
+            auto block = source.blocks.find(terms[i]);
+            if (block != source.blocks.end()) total += block->second.second;
+        }
+        blocks[i].resize(total);
+
+        uint64_t offset = 0;
+        for (const auto& source : positionSources) {
+            auto block = source.blocks.find(terms[i]);
+            if (block == source.blocks.end() || block->second.second == 0) continue;
+            if (batch.add(source.path, block->second.first, block->second.second, &blocks[i][offset])) {
+                readTerms.push_back(i);
+            } else {
+                std::cerr << " ERROR: Could not open positions file " << source.path << std::endl;
+            }
+            offset += block->second.second;
+        }
+    }
+    METRIC_ADD(BytesRead, batch.bytes());
+}
+
+
+std::vector<std::pair<int, int>> InvertedIndex::matchPhrase(const std::wstring& query, int window) const {
+    std::vector<std::pair<int, int>> matchedDocs; // docID -> number of matches
+    if (positionSources.empty()) {
+        if (verbose) std::wcout << L"Index was built without positions, rebuild it with --positions for phrase queries!" << std::endl;
+        return matchedDocs;
+    }
+
+    std::wstringstream wss(query);
+    std::wstring word;
+    std::vector<std::wstring> terms;
+    while (wss >> word) {
+        word = preprocessWord(word);
+        if (!word.empty()) {
+            terms.push_back(word);
+        }
+    }
+
+    if (terms.empty()) {
+        if (verbose) std::wcout << L"Query resulted in no valid terms after preprocessing!" << std::endl;
+        return matchedDocs;
+    }
+
+    // Every term must occur, and only then are its positions read from disk
+    std::vector<const std::vector<Posting>*> lists;
+    for (const auto& term : terms) {
+        auto it = index.find(term);
+        if (it == index.end()) {
+            if (verbose) std::wcout << L"No documents found matching the phrase!" << std::endl;
+            return matchedDocs;
+        }
+        lists.push_back(&it->second);
+    }
 
-    std::wcout << L"TF-IDF Results Count: " << results.size() << std::endl;
-    if (results.empty()) {
-        std::wcout << L"No documents found matching the query!" << std::endl;
+    // All positions blocks of the phrase are requested in one batch, read while the lists are intersected
+    std::vector<std::string> blocks;
+    std::vector<size_t> readTerms;
+    ReadBatch batch;
+    queuePositionsReads(terms, blocks, readTerms, batch);
+    batch.submit();
+
+    // Intersect the lists with nextGEQ jumps, keeping each term's posting index for the common documents
+    std::vector<size_t> cursors(terms.size(), 0);
+    std::vector<int> candidates;
+    std::vector<size_t> candidateCursors; // terms.size() entries per candidate
+    int target = 0;
+
+    while (true) {
+        bool aligned = true;
+        for (size_t i = 0; i < lists.size(); ++i) {
+            const auto& postings = *lists[i];
+            cursors[i] = std::lower_bound(postings.begin() + cursors[i], postings.end(), target,
+                                          [](const Posting& p, int docID) { return p.docID < docID; }) - postings.begin();
+            if (cursors[i] == postings.size()) {
+                aligned = false;
+                target = -1;
+                break;
+            }
+            if (postings[cursors[i]].docID > target) {
+                target = postings[cursors[i]].docID;
+                aligned = false;
+                break;
+            }
+        }
+
+        if (target == -1) break;
+        if (!aligned) continue;
+
+        if (!deletedDocs.isDeleted(target)) {
+            candidates.push_back(target);
+            candidateCursors.insert(candidateCursors.end(), cursors.begin(), cursors.end());
+        }
+        target++;
     }
 
+    // A term's positions are decoded for every candidate as soon as its last read lands, while the
+    // reads of the other terms are still in flight
+    std::vector<std::vector<std::vector<int>>> candidatePositions(terms.size()); // [term][candidate]
+    auto decode = [&](size_t i) {
+        PositionListReader reader(std::move(blocks[i]));
+        candidatePositions[i].reserve(candidates.size());
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            candidatePositions[i].push_back(reader.positionsAt(candidateCursors[c * terms.size() + i]));
+        }
+    };
+
+    std::vector<size_t> pendingReads(terms.size(), 0);
+    for (size_t term : readTerms) pendingReads[term]++;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (pendingReads[i] == 0) decode(i);
+    }
+    {
+        METRIC_STAGE(PositionsRead);
+        bool ok = true;
+        size_t read;
+        while ((read = batch.waitNext(ok)) != ReadBatch::npos) {
+            if (!ok) {
+                std::cerr << " ERROR: Reading positions for the phrase query failed." << std::endl;
+                return matchedDocs;
+            }
+            if (--pendingReads[readTerms[read]] == 0) decode(readTerms[read]);
+        }
+    }
+
+    // Then check the positions of the common documents
+    std::vector<const std::vector<int>*> termPositions(terms.size());
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        for (size_t i = 0; i < terms.size(); ++i) {
+            termPositions[i] = &candidatePositions[i][c];
+        }
+
+        int matches = (window <= 0) ? countPhraseMatches(termPositions) : countWindowMatches(termPositions, window);
+        if (matches > 0) {
+            matchedDocs.push_back({candidates[c], matches});
+        }
+    }
+
+    return matchedDocs;
+}
+
+
+std::vector<SearchResult> InvertedIndex::scorePhraseMatches(const std::vector<std::pair<int, int>>& matchedDocs, int phraseDocFreq) const {
+    // The phrase is scored like a single term: tf = matches, df = matching documents
+    std::vector<SearchResult> results;
+    for (const auto& [docID, matches] : matchedDocs) {
+        double tfidf = computeTFIDF(matches, docLengths.at(docID), phraseDocFreq);
+        if (tfidf > 0.0) {
+            results.push_back({docID, matches, tfidf});
+        }
+    }
+    return results;
+}
+
+
+std::vector<SearchResult> InvertedIndex::searchPhrase(const std::wstring& query, int window) const {
+    std::vector<std::pair<int, int>> matchedDocs = matchPhrase(query, window);
+    std::vector<SearchResult> results = scorePhraseMatches(matchedDocs, static_cast<int>(matchedDocs.size()));
+
+    std::sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
+        return a.tfidf > b.tfidf || (a.tfidf == b.tfidf && a.docID < b.docID);
+    });
+
+    if (verbose && !positionSources.empty()) std::wcout << L"Phrase Results Count: " << matchedDocs.size() << std::endl;
     if (results.size() > 20) results.resize(20);
 
     return results;
 }
 
 
+// -------------------- Structured Queries --------------------
+std::unique_ptr<QueryCursor> InvertedIndex::buildCursor(const QueryNode& node) const {
+    switch (node.type) {
+        case QueryNode::Type::Term:
+        case QueryNode::Type::Phrase: {
+            // Terms removed by preprocessing (e.g. stopwords) simply drop out of the query
+            std::vector<std::wstring> terms;
+            for (const auto& raw : node.terms) {
+                std::wstring term = preprocessWord(raw);
+                if (!term.empty()) terms.push_back(term);
+            }
+            if (terms.empty()) return nullptr;
+
+            if (terms.size() == 1) {
+                return std::make_unique<TermCursor>(*this, terms[0], node.boost);
+            }
+            if (!positionSources.empty()) {
+                return std::make_unique<PhraseCursor>(*this, terms, node.window, node.boost);
+            }
+
+            if (verbose) std::wcout << L"Index was built without positions, phrase treated as AND of its terms." << std::endl;
+            std::vector<std::unique_ptr<QueryCursor>> children;
+            for (const auto& term : terms) children.push_back(std::make_unique<TermCursor>(*this, term, node.boost));
+            return std::make_unique<AndCursor>(std::move(children));
+        }
+
+        case QueryNode::Type::Or: {
+            std::vector<std::unique_ptr<QueryCursor>> children;
+            for (const auto& child : node.children) {
+                if (auto cursor = buildCursor(*child)) children.push_back(std::move(cursor));
+            }
+            if (children.empty()) return nullptr;
+
+            std::unique_ptr<QueryCursor> cursor = (children.size() == 1) ? std::move(children[0])
+                                                                        : std::make_unique<OrCursor>(std::move(children));
+            if (node.boost != 1.0) cursor = std::make_unique<BoostCursor>(std::move(cursor), node.boost);
+            return cursor;
+        }
+
+        case QueryNode::Type::Boolean: {
+            auto combine = [this](const std::vector<std::unique_ptr<QueryNode>>& nodes, bool conjunctive) -> std::unique_ptr<QueryCursor> {
+                std::vector<std::unique_ptr<QueryCursor>> children;
+                for (const auto& child : nodes) {
+                    if (auto cursor = buildCursor(*child)) children.push_back(std::move(cursor));
+                }
+                if (children.empty()) return nullptr;
+                if (children.size() == 1) return std::move(children[0]);
+                if (conjunctive) return std::make_unique<AndCursor>(std::move(children));
+                return std::make_unique<OrCursor>(std::move(children));
+            };
+
+            auto required = combine(node.required, true);
+            auto optional = combine(node.optional, false);
+            auto excluded = combine(node.excluded, false);
+            if (!required && !optional) return nullptr;
+
+            std::unique_ptr<QueryCursor> cursor;
+            if (!excluded && (!required || !optional)) {
+                cursor = required ? std::move(required) : std::move(optional);
+            } else {
+                cursor = std::make_unique<BooleanCursor>(std::move(required), std::move(optional), std::move(excluded));
+            }
+            if (node.boost != 1.0) cursor = std::make_unique<BoostCursor>(std::move(cursor), node.boost);
+            return cursor;
+        }
+    }
+    return nullptr;
+}
+
+
+std::vector<SearchResult> InvertedIndex::searchQuery(const std::wstring& query, bool defaultConjunctive, size_t k) const {
+    std::vector<SearchResult> results;
+
+    METRIC_ADD(Queries, 1);
+
+    std::string error;
+    std::unique_ptr<QueryCursor> cursor;
+    {
+        METRIC_STAGE(Preprocess);
+        QueryParser parser(defaultConjunctive);
+        std::unique_ptr<QueryNode> tree = parser.parse(query, error);
+        if (!tree) {
+            if (verbose) std::wcout << L"Invalid query: " << utf8ToWstring(error) << std::endl;
+            return results;
+        }
+        cursor = buildCursor(*tree);
+    }
+
+    if (!cursor) {
+        if (verbose) std::wcout << L"Query resulted in no valid terms after preprocessing!" << std::endl;
+        return results;
+    }
+
+    // Single DAAT pass, keeping the best k in a min-heap on score (ties favour lower docIDs)
+    auto better = [](const SearchResult& a, const SearchResult& b) {
+        return a.tfidf > b.tfidf || (a.tfidf == b.tfidf && a.docID < b.docID);
+    };
+    std::priority_queue<SearchResult, std::vector<SearchResult>, decltype(better)> topK(better);
+    size_t matched = 0;
+
+    {
+        METRIC_STAGE(Scoring);
+        for (cursor->nextGEQ(0); cursor->docID() != QueryCursor::END; cursor->next()) {
+            double tfidf = cursor->score();
+            if (tfidf <= 0.0) continue;
+            matched++;
+
+            SearchResult result{cursor->docID(), cursor->frequency(), tfidf};
+            if (topK.size() < k) {
+                topK.push(result);
+            } else if (better(result, topK.top())) {
+                topK.pop();
+                topK.push(result);
+            }
+        }
+    }
+    METRIC_ADD(DocsScored, matched);
+
+    while (!topK.empty()) {
+        results.push_back(topK.top());
+        topK.pop();
+    }
+    std::reverse(results.begin(), results.end());
+
+    if (verbose) std::wcout << L"Query Results Count: " << matched << std::endl;
+    return results;
+}
+
 
 void InvertedIndex::openList(const std::wstring& term) const {
     currentTerm = term;
@@ -471,7 +1759,8 @@ void InvertedIndex::openList(const std::wstring& term) const {
         currentPosting = it->second.begin();
         endPosting = it->second.end();
     } else {
-        currentPosting = endPosting;
+        // Value-initialized iterators compare equal, unlike leftovers of an earlier list
+        currentPosting = endPosting = std::vector<Posting>::const_iterator();
     }
 
     lastDocID = -1;
@@ -489,10 +1778,14 @@ void InvertedIndex::closeList() const {
 
 
 int InvertedIndex::next() const {
-    if (currentPosting != endPosting) {
-        lastDocID = currentPosting->docID;
-        lastFreq = currentPosting->frequency;
-        ++currentPosting;
+    // Deleted documents are skipped here, so callers never see them
+    while (currentPosting != endPosting) {
+        const Posting& posting = *currentPosting++;
+        if (deletedDocs.isDeleted(posting.docID)) continue;
+
+        lastDocID = posting.docID;
+        lastFreq = posting.frequency;
+        METRIC_ADD(PostingsScanned, 1);
         return lastDocID;
     }
     return -1;
@@ -518,7 +1811,7 @@ double InvertedIndex::computeTF(int termFreq) const {
 }
 
 double InvertedIndex::computeIDF(int docCount) const {
-    return (docCount == 0) ? 0.0 : std::log(static_cast<double>(docLengths.size()) / docCount);
+    return (docCount == 0) ? 0.0 : std::log(static_cast<double>(liveDocCount()) / docCount);
 }
 
 double InvertedIndex::computeTFIDF(int termFreq, int /*docLength*/, int docCount) const {
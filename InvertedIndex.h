@@ -7,6 +7,12 @@
 #include <utility>
 #include <queue>
 #include <fstream>
+#include <memory>
+#include <atomic>
+#include <climits>
+#include "DeletedDocs.h"
+#include "PositionalIndex.h"
+#include "AsyncIO.h"
 
 // Posting structure for document ID and frequency
 struct Posting {
@@ -21,6 +27,29 @@ struct SearchResult {
     double tfidf;
 };
 
+class QueryCursor;
+struct QueryNode;
+
+// How searchWithTFIDF uses tier 1 of a pruned index (see StaticPruning.h)
+enum class TierMode {
+    Off,    // Always scan the full lists
+    Safe,   // Serve from tier 1 only when it provably holds the exact top 20, else fall back to the full lists
+    Unsafe  // Always serve from tier 1: fastest, but may miss documents whose postings were pruned
+};
+
+// Queries answered from tier 1 and queries that had to fall back to the full lists
+struct TierStats {
+    uint64_t served = 0;
+    uint64_t fallbacks = 0;
+};
+
+// Delta segment holding an incrementally appended batch of documents
+struct SegmentInfo {
+    std::string name;   // Subdirectory of the index path (e.g. "segment_3")
+    int firstDocID;     // DocIDs in the segment are contiguous from here
+    int numDocs;
+};
+
 // MergeNode for priority queue in multi-way merge (SPIMI)
 struct MergeNode {
     std::wstring term;
@@ -33,6 +62,9 @@ struct MergeNode {
 
 class InvertedIndex {
 public:
+    // Also record token positions in a separate stream when building (needed for phrase queries)
+    void setPositional(bool enabled) { positional = enabled; }
+
     // Builds the inverted index using SPIMI
     void buildIndexSPIMI(const std::unordered_map<int, std::wstring>& documents, int chunkSize, const std::string& indexPath);
 
@@ -42,11 +74,49 @@ public:
     // Merges partial index files into a final index
     void mergeIndexes(int numChunks, const std::string& indexPath);
 
+    // Indexes a new batch into a delta segment and applies the tiered merge policy
+    // Optional docnos override the default docno == docID mapping (used by updateDocument);
+    // returns false if the segment could not be built, in which case nothing is recorded
+    bool appendSegment(const std::unordered_map<int, std::wstring>& documents, const std::string& indexPath,
+                       const std::unordered_map<int, int>& docnos = {});
+
+    // Tombstones every live document with the given docno; returns false if none was found.
+    // Rewrites the main index without them once purgeDeletedRatio of its documents are deleted.
+    bool deleteDocument(int docno, const std::string& indexPath);
+
+    // Replaces a document: appends the new text under the same docno, then tombstones the old
+    // version; a failed append leaves the old version live and returns false
+    bool updateDocument(int docno, const std::wstring& text, const std::string& indexPath);
+
+    // Merges runs of similarly sized adjacent segments so the segment count stays bounded
+    void mergeSegments(const std::string& indexPath);
+
+    // Segment list and next free docID, persisted in segments.dat
+    static std::vector<SegmentInfo> readSegments(const std::string& indexPath, int& nextDocID);
+    static void writeSegments(const std::string& indexPath, const std::vector<SegmentInfo>& segments, int nextDocID);
+
+    // Parses one "<term> <n> <docIDs...> <freqs...>" line of a final_index.dat file
+    static bool parsePostingsLine(const std::string& line, std::wstring& wterm, std::vector<Posting>& postings);
+
+    // Counts the index_chunk_*.dat files written by buildIndexSPIMI
+    static int countChunks(const std::string& indexPath);
+
     // Saves the index, lexicon, and metadata to files
     //void saveIndex(const std::string& indexPath) const;
 
-    // Loads the final merged index from disk
-    void loadIndex(const std::string& indexPath);
+    // Loads the final merged index and all delta segments from disk
+    bool loadIndex(const std::string& indexPath);
+
+    // Replaces the local N and df with collection-wide values (global_stats.dat of a sharded build);
+    // call after loadIndex
+    bool loadGlobalStats(const std::string& path);
+
+    // Whether searches print result counts and diagnostics to wcout
+    void setVerbose(bool enabled) { verbose = enabled; }
+
+    // Only has an effect when the index was built with a pruned tier 1
+    void setTierMode(TierMode mode) { tierMode = mode; }
+    TierStats tierStats() const { return {tier1Served.load(), tier1Fallbacks.load()}; }
 
     static int estimateChunkSize();
 
@@ -56,6 +126,29 @@ public:
     // Searches for documents with TF-IDF scoring and returns ranked results
     std::vector<SearchResult> searchWithTFIDF(const std::wstring& query, bool conjunctive) const;
 
+    // Ranks documents containing the query as an exact phrase (window 0) or with all
+    // terms inside a span of window positions; requires an index built with positions
+    std::vector<SearchResult> searchPhrase(const std::wstring& query, int window) const;
+
+    // The two halves of searchPhrase, so a sharded search can sum phraseDocFreq over all shards
+    // before scoring: matchPhrase returns (docID, matches) pairs, scorePhraseMatches the unsorted results
+    std::vector<std::pair<int, int>> matchPhrase(const std::wstring& query, int window) const;
+    std::vector<SearchResult> scorePhraseMatches(const std::vector<std::pair<int, int>>& matchedDocs, int phraseDocFreq) const;
+
+    // Evaluates a structured query (see QueryParser.h) in one document-at-a-time pass and
+    // returns the top k documents; defaultConjunctive decides how plain adjacent terms combine
+    std::vector<SearchResult> searchQuery(const std::wstring& query, bool defaultConjunctive, size_t k = 20) const;
+
+    // External document number of a docID; docIDs change on --reorder and updates, docnos do not
+    int docno(int docID) const;
+
+    // Whether docID is in the loaded doc table (main index or a segment)
+    bool hasDocument(int docID) const { return docLengths.count(docID) > 0; }
+
+    // Term-at-a-time iteration over one postings list (deleted documents are skipped).
+    // The cursor is shared state of the index, so these are for single-threaded callers;
+    // the search functions iterate their lists locally and are safe to call concurrently.
+
     // Opens the postings list for a given term
     void openList(const std::wstring& term) const;
 
@@ -69,6 +162,68 @@ public:
     int getFreq() const;
 
 private:
+    // Cursors read postings, tombstones and scoring directly
+    friend class TermCursor;
+    friend class PhraseCursor;
+
+    // Builds the cursor tree for a parsed query node; nullptr if nothing in it can match
+    std::unique_ptr<QueryCursor> buildCursor(const QueryNode& node) const;
+
+    // Segments of the same tier are merged once this many are adjacent
+    static const int segmentMergeFactor = 4;
+
+    // Smallest segment size considered when assigning tiers
+    static const int segmentTierBase = 1000;
+
+    // Share of deleted main-index documents at which deleteDocument purges their postings
+    static constexpr double purgeDeletedRatio = 0.2;
+
+    // mergeIndexes only splits the term space when every range gets at least this many terms
+    static const int minTermsPerMergePart = 1024;
+
+    // Merges the postings (and positions) of terms in [first, last) from all chunks into the part
+    // files final_*.dat.part<part>, sorted by term; an empty bound is open. Each chunk is read only
+    // from its offsets-table entry before first up to last, in one streaming k-way merge.
+    bool mergeTermRange(int numChunks, const std::string& indexPath, const std::string& first,
+                        const std::string& last, int part) const;
+
+    // Loads one set of final_* files, appending postings to those already loaded
+    bool loadIndexFiles(const std::string& dir);
+
+    // Concatenates the final_* files of docID-ordered segments into outDir, dropping deleted docs
+    void mergeSegmentFiles(const std::vector<std::string>& dirs, const std::string& outDir, const DeletedDocs& deleted);
+
+    // Sizes blocks[i] and queues reads of terms[i]'s positions blocks from every loaded index
+    // directory (in load order) into batch; readTerms gets the term index of each queued read.
+    // The caller submits the batch and waits for it.
+    void queuePositionsReads(const std::vector<std::wstring>& terms, std::vector<std::string>& blocks,
+                             std::vector<size_t>& readTerms, ReadBatch& batch) const;
+
+    // Loads tier1_index.dat and tier1_cutoffs.dat of the main index, if present
+    void loadTier1(const std::string& indexPath);
+
+    // Ranks the candidates of tier 1 exactly against the full lists; false if tier 1 cannot
+    // guarantee the top 20 (Safe mode) so the caller must scan the full lists instead
+    bool searchTier1(const std::vector<std::wstring>& terms, bool conjunctive, std::vector<SearchResult>& results) const;
+
+    // Number of documents that have not been deleted (N in the IDF)
+    int liveDocCount() const;
+
+    // Number of live documents in a term's postings list (df in the IDF)
+    int documentFrequency(const std::wstring& term, const std::vector<Posting>& postings) const;
+
+    // Recomputes liveDocFreqs after the loaded postings or tombstones changed
+    void refreshLiveDocFreqs();
+
+    // Docs of docno in the main index and its segments (from memory when loaded, else from disk)
+    std::vector<int> docIDsOfDocno(int docno, const std::string& indexPath) const;
+
+    // Sets the tombstones of docIDs and saves the bitmap; false if none of them was live
+    bool tombstone(const std::vector<int>& docIDs, const std::string& indexPath);
+
+    // Rewrites the main index without deleted documents if at least purgeDeletedRatio of it is deleted
+    void purgeMainIndex(const std::string& indexPath);
+
     // Mapping of term IDs to terms (lexicon)
     std::unordered_map<int, std::wstring> lexicon;
 
@@ -78,6 +233,42 @@ private:
     // Mapping of document IDs to external document numbers
     std::unordered_map<int, int> docIDToDocno;
 
+    // Tombstones of deleted documents, skipped by next()
+    DeletedDocs deletedDocs;
+
+    // Deleted documents whose postings are still loaded
+    int numDeletedLoaded = 0;
+
+    // df of the terms whose loaded postings include deleted documents; other terms use the list size
+    std::unordered_map<std::wstring, int> liveDocFreqs;
+
+    // Whether buildIndexSPIMI records positions
+    bool positional = false;
+
+    bool verbose = true;
+
+    // Tier 1 of a pruned index: each term's highest-frequency postings (docID order) and the largest
+    // frequency that was left out (0 = the list is complete)
+    struct TierList {
+        std::vector<Posting> postings;
+        int cutoffFreq = 0;
+    };
+    std::unordered_map<std::wstring, TierList> tier1;
+    int tier1End = INT_MAX; // DocIDs from here on (delta segments) are not covered by tier 1
+    TierMode tierMode = TierMode::Safe;
+    mutable std::atomic<uint64_t> tier1Served{0};
+    mutable std::atomic<uint64_t> tier1Fallbacks{0};
+
+    // Collection-wide statistics when this index is one shard (0 = use local statistics)
+    int globalNumDocs = 0;
+    std::unordered_map<std::wstring, int> globalDocFreqs;
+
+    // Positions of the current SPIMI chunk: term -> docID -> token positions
+    std::unordered_map<std::wstring, std::unordered_map<int, std::vector<int>>> partialPositions;
+
+    // Positions streams of the main index and its segments, in the same order as their postings
+    std::vector<PositionsFile> positionSources;
+
     // Inverted index structure: term -> postings list
     mutable std::unordered_map<std::wstring, std::vector<Posting>> index;
 
@@ -0,0 +1,154 @@
+#include "Metrics.h"
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const char* counterNames[numCounters] = {
+    "postings_scanned", "docs_scored", "term_lookups", "term_misses", "bytes_read",
+    "bytes_decoded", "queries", "docs_tokenized", "spimi_inserts", "chunks_written",
+    "server_requests", "server_batches", "server_timeouts",
+};
+
+const char* stageNames[numStages] = {
+    "parse", "tokenize", "chunk_write", "merge", "load", "preprocess",
+    "posting_lookup", "intersection", "scoring", "sort", "positions_read", "queue_wait",
+};
+
+// Written only by its owning thread, read by snapshot() from any thread
+struct ThreadMetrics {
+    std::atomic<uint64_t> counters[numCounters] = {};
+    std::atomic<uint64_t> stageCount[numStages] = {};
+    std::atomic<uint64_t> stageNanos[numStages] = {};
+    std::atomic<uint64_t> stageBuckets[numStages][numLatencyBuckets] = {};
+};
+
+// Single writer, so a relaxed load + store is enough and avoids an atomic read-modify-write
+inline void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+std::mutex registryMutex;
+
+// Blocks outlive their threads so totals never go backwards
+std::vector<std::shared_ptr<ThreadMetrics>>& registry() {
+    static std::vector<std::shared_ptr<ThreadMetrics>> blocks;
+    return blocks;
+}
+
+ThreadMetrics& local() {
+    thread_local ThreadMetrics* block = [] {
+        auto created = std::make_shared<ThreadMetrics>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry().push_back(created);
+        return created.get();
+    }();
+    return *block;
+}
+
+int bucketFor(uint64_t nanos) {
+    int bucket = 0;
+    while (bucket < numLatencyBuckets - 1 && (uint64_t(1) << bucket) <= nanos) bucket++;
+    return bucket;
+}
+
+} // namespace
+
+bool Metrics::enabled() {
+#ifdef ENABLE_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void Metrics::add(Counter counter, uint64_t amount) {
+    bump(local().counters[static_cast<int>(counter)], amount);
+}
+
+
+void Metrics::recordStage(Stage stage, uint64_t nanos) {
+    ThreadMetrics& metrics = local();
+    int index = static_cast<int>(stage);
+    bump(metrics.stageCount[index], 1);
+    bump(metrics.stageNanos[index], nanos);
+    bump(metrics.stageBuckets[index][bucketFor(nanos)], 1);
+}
+
+
+MetricsSnapshot Metrics::snapshot() {
+    MetricsSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& block : registry()) {
+        for (int c = 0; c < numCounters; ++c) {
+            snapshot.counters[c] += block->counters[c].load(std::memory_order_relaxed);
+        }
+        for (int s = 0; s < numStages; ++s) {
+            snapshot.stageCount[s] += block->stageCount[s].load(std::memory_order_relaxed);
+            snapshot.stageNanos[s] += block->stageNanos[s].load(std::memory_order_relaxed);
+            for (int b = 0; b < numLatencyBuckets; ++b) {
+                snapshot.stageBuckets[s][b] += block->stageBuckets[s][b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return snapshot;
+}
+
+
+MetricsSnapshot MetricsSnapshot::operator-(const MetricsSnapshot& earlier) const {
+    MetricsSnapshot diff;
+    for (int c = 0; c < numCounters; ++c) diff.counters[c] = counters[c] - earlier.counters[c];
+    for (int s = 0; s < numStages; ++s) {
+        diff.stageCount[s] = stageCount[s] - earlier.stageCount[s];
+        diff.stageNanos[s] = stageNanos[s] - earlier.stageNanos[s];
+        for (int b = 0; b < numLatencyBuckets; ++b) {
+            diff.stageBuckets[s][b] = stageBuckets[s][b] - earlier.stageBuckets[s][b];
+        }
+    }
+    return diff;
+}
+
+
+std::string MetricsSnapshot::toJson() const {
+    std::ostringstream json;
+    json << "{\"enabled\": " << (Metrics::enabled() ? "true" : "false") << ", \"counters\": {";
+    for (int c = 0; c < numCounters; ++c) {
+        json << (c ? ", " : "") << "\"" << counterNames[c] << "\": " << counters[c];
+    }
+    json << "}, \"stages\": {";
+    bool first = true;
+    for (int s = 0; s < numStages; ++s) {
+        if (stageCount[s] == 0) continue;
+        json << (first ? "" : ", ") << "\"" << stageNames[s] << "\": {\"count\": " << stageCount[s]
+             << ", \"seconds\": " << stageNanos[s] / 1e9 << "}";
+        first = false;
+    }
+    json << "}}";
+    return json.str();
+}
+
+
+std::string MetricsSnapshot::toPrometheus() const {
+    std::ostringstream text;
+    for (int c = 0; c < numCounters; ++c) {
+        text << "# TYPE mircv_" << counterNames[c] << "_total counter\n";
+        text << "mircv_" << counterNames[c] << "_total " << counters[c] << "\n";
+    }
+
+    text << "# TYPE mircv_stage_seconds histogram\n";
+    for (int s = 0; s < numStages; ++s) {
+        uint64_t cumulative = 0;
+        for (int b = 0; b < numLatencyBuckets - 1; ++b) {
+            cumulative += stageBuckets[s][b];
+            text << "mircv_stage_seconds_bucket{stage=\"" << stageNames[s] << "\",le=\""
+                 << static_cast<double>(uint64_t(1) << b) / 1e9 << "\"} " << cumulative << "\n";
+        }
+        text << "mircv_stage_seconds_bucket{stage=\"" << stageNames[s] << "\",le=\"+Inf\"} " << stageCount[s] << "\n";
+        text << "mircv_stage_seconds_sum{stage=\"" << stageNames[s] << "\"} " << stageNanos[s] / 1e9 << "\n";
+        text << "mircv_stage_seconds_count{stage=\"" << stageNames[s] << "\"} " << stageCount[s] << "\n";
+    }
+    return text.str();
+}
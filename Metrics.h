@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Low-overhead instrumentation of the indexing and query hot paths. Each thread writes to its
+// own block of relaxed atomics (no contention, no lock prefix on the owning thread); a snapshot
+// sums every block. Without -DENABLE_METRICS the METRIC_* macros compile to nothing.
+
+enum class Counter {
+    PostingsScanned,   // postings visited by next() or a cursor
+    DocsScored,        // documents that received a TF-IDF score
+    TermLookups,       // lexicon lookups of query terms
+    TermMisses,        // query terms missing from the lexicon
+    BytesRead,         // bytes read from disk at query time (positions blocks)
+    BytesDecoded,      // compressed bytes decoded (VByte positions)
+    Queries,
+    DocsTokenized,
+    SpimiInserts,      // (term, doc) postings added to SPIMI chunks
+    ChunksWritten,
+    ServerRequests,    // requests received by QueryServer
+    ServerBatches,     // micro-batches taken off the request queue
+    ServerTimeouts,    // requests answered with "timeout" because their deadline passed
+    Count
+};
+
+enum class Stage {
+    Parse,             // DocumentParser::parseDocuments
+    Tokenize,          // per-document tokenizing inside buildIndexSPIMI
+    ChunkWrite,
+    Merge,
+    Load,
+    Preprocess,        // query term preprocessing / parsing
+    PostingLookup,     // finding and iterating postings lists
+    Intersection,      // conjunctive set intersection
+    Scoring,           // cursor evaluation / TF-IDF accumulation
+    Sort,              // ranking and top-k selection
+    PositionsRead,
+    QueueWait,         // QueryServer: from request arrival until a worker picks it up
+    Count
+};
+
+constexpr int numCounters = static_cast<int>(Counter::Count);
+constexpr int numStages = static_cast<int>(Stage::Count);
+constexpr int numLatencyBuckets = 40; // bucket i: latencies below 2^i nanoseconds
+
+// Summed view of all threads' metrics
+struct MetricsSnapshot {
+    uint64_t counters[numCounters] = {};
+    uint64_t stageCount[numStages] = {};
+    uint64_t stageNanos[numStages] = {};
+    uint64_t stageBuckets[numStages][numLatencyBuckets] = {};
+
+    // Difference to an earlier snapshot, e.g. the cost of a single query
+    MetricsSnapshot operator-(const MetricsSnapshot& earlier) const;
+
+    std::string toJson() const;
+    std::string toPrometheus() const;
+};
+
+class Metrics {
+public:
+    static bool enabled();
+
+    static void add(Counter counter, uint64_t amount);
+    static void recordStage(Stage stage, uint64_t nanos);
+
+    static MetricsSnapshot snapshot();
+};
+
+// Records the lifetime of a scope as one sample of a stage
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~ScopedStageTimer() {
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        Metrics::recordStage(stage, static_cast<uint64_t>(nanos));
+    }
+
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef ENABLE_METRICS
+#define METRIC_ADD(counter, amount) Metrics::add(Counter::counter, static_cast<uint64_t>(amount))
+#define METRIC_STAGE(stage) ScopedStageTimer metricStageTimer##stage(Stage::stage)
+#define METRIC_STAGE_NANOS(stage, nanos) Metrics::recordStage(Stage::stage, static_cast<uint64_t>(nanos))
+#else
+#define METRIC_ADD(counter, amount) ((void)0)
+#define METRIC_STAGE(stage) ((void)0)
+#define METRIC_STAGE_NANOS(stage, nanos) ((void)0)
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,162 @@
+#include "PositionalIndex.h"
+#include "utils.h"
+#include "Metrics.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+void encodeVByte(uint32_t value, std::string& out) {
+    while (value >= 128) {
+        out.push_back(static_cast<char>(value & 127));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value | 128));
+}
+
+
+uint32_t decodeVByte(const unsigned char*& p, const unsigned char* end) {
+    uint32_t value = 0;
+    int shift = 0;
+    while (p < end) {
+        unsigned char byte = *p++;
+        value |= static_cast<uint32_t>(byte & 127) << shift;
+        if (byte & 128) break;
+        shift += 7;
+    }
+    return value;
+}
+
+
+void encodePositions(const std::vector<int>& positions, std::string& out) {
+    encodeVByte(static_cast<uint32_t>(positions.size()), out);
+    int previous = 0;
+    for (int position : positions) {
+        encodeVByte(static_cast<uint32_t>(position - previous), out);
+        previous = position;
+    }
+}
+
+
+bool PositionsFile::load(const std::string& dir) {
+    std::ifstream lexiconFile(dir + "/final_positions_lexicon.dat");
+    if (!lexiconFile.is_open()) {
+        return false;
+    }
+
+    path = dir + "/final_positions.dat";
+    blocks.clear();
+
+    std::string term;
+    uint64_t offset, length;
+    while (lexiconFile >> term >> offset >> length) {
+        blocks[utf8ToWstring(term)] = {offset, length};
+    }
+    return true;
+}
+
+
+PositionListReader::PositionListReader(std::string bytes) : data(std::move(bytes)) {
+    cursor = reinterpret_cast<const unsigned char*>(data.data());
+    end = cursor + data.size();
+}
+
+
+const std::vector<int>& PositionListReader::positionsAt(size_t postingIndex) {
+#ifdef ENABLE_METRICS
+    const unsigned char* startCursor = cursor;
+#endif
+
+    // Skip the postings in between without materializing their positions
+    while (nextPosting < postingIndex && cursor < end) {
+        uint32_t count = decodeVByte(cursor, end);
+        for (uint32_t i = 0; i < count; ++i) decodeVByte(cursor, end);
+        ++nextPosting;
+    }
+
+    if (nextPosting == postingIndex && cursor < end) {
+        uint32_t count = decodeVByte(cursor, end);
+        current.resize(count);
+        int position = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            position += static_cast<int>(decodeVByte(cursor, end));
+            current[i] = position;
+        }
+        ++nextPosting;
+    }
+
+    METRIC_ADD(BytesDecoded, cursor - startCursor);
+    return current;
+}
+
+
+int countPhraseMatches(const std::vector<const std::vector<int>*>& termPositions) {
+    if (termPositions.empty()) return 0;
+
+    std::vector<PositionCursor> cursors;
+    for (const auto* positions : termPositions) cursors.emplace_back(*positions);
+
+    // Anchor on each position of the first term and require term i at anchor + i
+    int matches = 0;
+    int anchor = cursors[0].nextGEQ(0);
+    while (anchor != INT_MAX) {
+        int target = anchor;
+        size_t i = 1;
+        for (; i < cursors.size(); ++i) {
+            int position = cursors[i].nextGEQ(anchor + static_cast<int>(i));
+            if (position == INT_MAX) return matches;
+            if (position != anchor + static_cast<int>(i)) {
+                // Next anchor that could still line up with this term
+                target = position - static_cast<int>(i);
+                break;
+            }
+        }
+        if (i == cursors.size()) {
+            matches++;
+            target = anchor + 1;
+        }
+        anchor = cursors[0].nextGEQ(std::max(target, anchor + 1));
+    }
+    return matches;
+}
+
+
+int countWindowMatches(const std::vector<const std::vector<int>*>& termPositions, int window) {
+    if (termPositions.empty()) return 0;
+
+    // A repeated query term ("york york") needs as many distinct occurrences as it is repeated,
+    // so each distinct term contributes a run of that many consecutive positions. Different terms
+    // never share a position, so equal lists mean the same term.
+    struct TermRun {
+        const std::vector<int>* positions;
+        size_t count;
+        size_t start = 0;
+    };
+    std::vector<TermRun> runs;
+    for (const auto* positions : termPositions) {
+        auto same = std::find_if(runs.begin(), runs.end(), [positions](const TermRun& run) {
+            return run.positions == positions || *run.positions == *positions;
+        });
+        if (same != runs.end()) same->count++;
+        else runs.push_back({positions, 1});
+    }
+    for (const auto& run : runs) {
+        if (run.positions->size() < run.count) return 0;
+    }
+
+    // Slide over the run with the smallest first position: each step yields the tightest window starting there
+    int matches = 0;
+    while (true) {
+        size_t minIndex = 0;
+        int maxPosition = INT_MIN;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            const TermRun& run = runs[i];
+            if ((*run.positions)[run.start] < (*runs[minIndex].positions)[runs[minIndex].start]) minIndex = i;
+            maxPosition = std::max(maxPosition, (*run.positions)[run.start + run.count - 1]);
+        }
+        TermRun& first = runs[minIndex];
+        if (maxPosition - (*first.positions)[first.start] < window) matches++;
+
+        first.start++;
+        if (first.start + first.count > first.positions->size()) return matches;
+    }
+}
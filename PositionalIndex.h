@@ -0,0 +1,71 @@
+#ifndef POSITIONAL_INDEX_H
+#define POSITIONAL_INDEX_H
+
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <climits>
+
+// Positions of every posting are kept in a separate stream (final_positions.dat), so
+// queries that do not need them never read it. For each term the stream holds, per posting
+// and in docID order, VByte(count) followed by VByte d-gaps of the token positions.
+
+// Appends the VByte encoding of value to out (7 bits per byte, high bit marks the last byte)
+void encodeVByte(uint32_t value, std::string& out);
+
+// Decodes one VByte value and advances p
+uint32_t decodeVByte(const unsigned char*& p, const unsigned char* end);
+
+// Appends the count and d-gap encoded positions of one posting to out
+void encodePositions(const std::vector<int>& positions, std::string& out);
+
+// Location of each term's block inside one final_positions.dat file
+struct PositionsFile {
+    std::string path;
+    std::unordered_map<std::wstring, std::pair<uint64_t, uint64_t>> blocks; // term -> (offset, length)
+
+    // Reads final_positions_lexicon.dat from an index directory; false if the index has no positions
+    bool load(const std::string& dir);
+};
+
+// Walks the positions blocks of one term posting by posting
+class PositionListReader {
+public:
+    explicit PositionListReader(std::string data);
+
+    // Decodes the positions of posting number postingIndex; indexes must not decrease
+    const std::vector<int>& positionsAt(size_t postingIndex);
+
+private:
+    std::string data;
+    const unsigned char* cursor;
+    const unsigned char* end;
+    size_t nextPosting = 0;
+    std::vector<int> current;
+};
+
+// nextGEQ-style iteration over the sorted positions of a term in one document
+class PositionCursor {
+public:
+    explicit PositionCursor(const std::vector<int>& positions) : positions(&positions) {}
+
+    // Returns the first position >= target (INT_MAX once exhausted); never moves backwards
+    int nextGEQ(int target) {
+        while (index < positions->size() && (*positions)[index] < target) ++index;
+        return index < positions->size() ? (*positions)[index] : INT_MAX;
+    }
+
+private:
+    const std::vector<int>* positions;
+    size_t index = 0;
+};
+
+// Counts occurrences of the terms as a consecutive phrase
+int countPhraseMatches(const std::vector<const std::vector<int>*>& termPositions);
+
+// Counts minimal windows of at most window positions that contain every term (in any order);
+// a term repeated in the query must occur that many times inside the window
+int countWindowMatches(const std::vector<const std::vector<int>*>& termPositions, int window);
+
+#endif // POSITIONAL_INDEX_H
@@ -0,0 +1,307 @@
+#include "QueryCursor.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <iostream>
+
+// -------------------- TermCursor --------------------
+TermCursor::TermCursor(const InvertedIndex& index, const std::wstring& term, double boost)
+    : invertedIndex(index), boost(boost) {
+    METRIC_ADD(TermLookups, 1);
+    auto it = index.index.find(term);
+    if (it == index.index.end()) {
+        METRIC_ADD(TermMisses, 1);
+    } else {
+        postings = &it->second;
+        docFreq = index.documentFrequency(term, it->second);
+        current = -1;
+    }
+}
+
+
+void TermCursor::nextGEQ(int target) {
+    if (current >= target || !postings) return;
+
+    // Gallop ahead from the current posting, then binary search the last step
+    size_t n = postings->size();
+    size_t lo = index;
+    size_t hi = index;
+    size_t step = 1;
+    while (hi < n && (*postings)[hi].docID < target) {
+        lo = hi + 1;
+        hi = index + step;
+        step <<= 1;
+    }
+    hi = std::min(hi, n);
+
+    [[maybe_unused]] size_t previous = index;
+    index = std::lower_bound(postings->begin() + lo, postings->begin() + hi, target,
+                             [](const Posting& p, int docID) { return p.docID < docID; }) - postings->begin();
+    settle();
+    METRIC_ADD(PostingsScanned, index - previous);
+}
+
+
+void TermCursor::settle() {
+    while (index < postings->size() && invertedIndex.deletedDocs.isDeleted((*postings)[index].docID)) {
+        ++index;
+    }
+    current = (index < postings->size()) ? (*postings)[index].docID : END;
+}
+
+
+double TermCursor::score() const {
+    const Posting& posting = (*postings)[index];
+    return boost * invertedIndex.computeTFIDF(posting.frequency, invertedIndex.docLengths.at(posting.docID), docFreq);
+}
+
+
+int TermCursor::frequency() const {
+    return (*postings)[index].frequency;
+}
+
+
+// -------------------- AndCursor --------------------
+AndCursor::AndCursor(std::vector<std::unique_ptr<QueryCursor>> children) : children(std::move(children)) {
+    std::sort(this->children.begin(), this->children.end(),
+              [](const auto& a, const auto& b) { return a->cost() < b->cost(); });
+}
+
+
+void AndCursor::nextGEQ(int target) {
+    if (current >= target) return;
+    if (children.empty()) {
+        current = END;
+        return;
+    }
+
+    int candidate = target;
+    while (true) {
+        children[0]->nextGEQ(candidate);
+        candidate = children[0]->docID();
+        if (candidate == END) {
+            current = END;
+            return;
+        }
+
+        bool aligned = true;
+        for (size_t i = 1; i < children.size(); ++i) {
+            children[i]->nextGEQ(candidate);
+            int docID = children[i]->docID();
+            if (docID != candidate) {
+                if (docID == END) {
+                    current = END;
+                    return;
+                }
+                candidate = docID;
+                aligned = false;
+                break;
+            }
+        }
+
+        if (aligned) {
+            current = candidate;
+            return;
+        }
+    }
+}
+
+
+double AndCursor::score() const {
+    double total = 0.0;
+    for (const auto& child : children) total += child->score();
+    return total;
+}
+
+
+int AndCursor::frequency() const {
+    int total = 0;
+    for (const auto& child : children) total += child->frequency();
+    return total;
+}
+
+
+// -------------------- OrCursor --------------------
+OrCursor::OrCursor(std::vector<std::unique_ptr<QueryCursor>> children) : children(std::move(children)) {}
+
+
+void OrCursor::nextGEQ(int target) {
+    if (current >= target) return;
+
+    current = END;
+    for (auto& child : children) {
+        if (child->docID() < target) child->nextGEQ(target);
+        current = std::min(current, child->docID());
+    }
+}
+
+
+double OrCursor::score() const {
+    double total = 0.0;
+    for (const auto& child : children) {
+        if (child->docID() == current) total += child->score();
+    }
+    return total;
+}
+
+
+int OrCursor::frequency() const {
+    int total = 0;
+    for (const auto& child : children) {
+        if (child->docID() == current) total += child->frequency();
+    }
+    return total;
+}
+
+
+size_t OrCursor::cost() const {
+    size_t total = 0;
+    for (const auto& child : children) total += child->cost();
+    return total;
+}
+
+
+// -------------------- BooleanCursor --------------------
+BooleanCursor::BooleanCursor(std::unique_ptr<QueryCursor> required, std::unique_ptr<QueryCursor> optional,
+                             std::unique_ptr<QueryCursor> excluded)
+    : required(std::move(required)), optional(std::move(optional)), excluded(std::move(excluded)) {
+    positive = this->required ? this->required.get() : this->optional.get();
+}
+
+
+void BooleanCursor::nextGEQ(int target) {
+    positive->nextGEQ(target);
+
+    // Skip candidates the excluded cursor also lands on
+    if (excluded) {
+        while (positive->docID() != END) {
+            excluded->nextGEQ(positive->docID());
+            if (excluded->docID() != positive->docID()) break;
+            positive->next();
+        }
+    }
+
+    if (required && optional && positive->docID() != END) {
+        optional->nextGEQ(positive->docID());
+    }
+}
+
+
+double BooleanCursor::score() const {
+    double total = positive->score();
+    if (required && optional && optional->docID() == positive->docID()) total += optional->score();
+    return total;
+}
+
+
+int BooleanCursor::frequency() const {
+    int total = positive->frequency();
+    if (required && optional && optional->docID() == positive->docID()) total += optional->frequency();
+    return total;
+}
+
+
+// -------------------- PhraseCursor --------------------
+PhraseCursor::PhraseCursor(const InvertedIndex& index, const std::vector<std::wstring>& phraseTerms, int window, double boost)
+    : window(window), batch(std::make_unique<ReadBatch>()) {
+    for (const auto& term : phraseTerms) {
+        terms.push_back(std::make_unique<TermCursor>(index, term, boost));
+    }
+
+    // The positions are read while the cursor walks the postings to its first candidate
+    index.queuePositionsReads(phraseTerms, blocks, readTerms, *batch);
+    batch->submit();
+    readers.resize(phraseTerms.size());
+    pendingReads.assign(phraseTerms.size(), 0);
+    for (size_t term : readTerms) pendingReads[term]++;
+}
+
+
+void PhraseCursor::nextGEQ(int target) {
+    if (current >= target) return;
+
+    // Rarest term leads the intersection; term order is kept for the positions check
+    size_t lead = 0;
+    for (size_t i = 1; i < terms.size(); ++i) {
+        if (terms[i]->cost() < terms[lead]->cost()) lead = i;
+    }
+
+    int candidate = target;
+    while (true) {
+        terms[lead]->nextGEQ(candidate);
+        candidate = terms[lead]->docID();
+        if (candidate == END) {
+            current = END;
+            return;
+        }
+
+        bool aligned = true;
+        for (size_t i = 0; i < terms.size() && aligned; ++i) {
+            terms[i]->nextGEQ(candidate);
+            int docID = terms[i]->docID();
+            if (docID == END) {
+                current = END;
+                return;
+            }
+            if (docID != candidate) {
+                candidate = docID;
+                aligned = false;
+            }
+        }
+
+        if (aligned) {
+            if (positionsMatch()) {
+                current = candidate;
+                return;
+            }
+            candidate++;
+        }
+    }
+}
+
+
+bool PhraseCursor::positionsMatch() {
+    // On the first candidate, each term's positions are decoded as soon as its reads land, while
+    // the other terms' reads are still in flight
+    std::vector<const std::vector<int>*> termPositions(terms.size());
+    auto decode = [&](size_t i) {
+        if (!readers[i]) readers[i] = std::make_unique<PositionListReader>(std::move(blocks[i]));
+        termPositions[i] = &readers[i]->positionsAt(terms[i]->postingIndex());
+    };
+
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (pendingReads[i] == 0) decode(i);
+    }
+    if (batch) {
+        METRIC_STAGE(PositionsRead);
+        bool ok = true;
+        size_t read;
+        while ((read = batch->waitNext(ok)) != ReadBatch::npos) {
+            if (!ok) std::cerr << " ERROR: Reading positions for the phrase query failed." << std::endl;
+            if (--pendingReads[readTerms[read]] == 0) decode(readTerms[read]);
+        }
+        batch.reset();
+    }
+    int matches = (window <= 0) ? countPhraseMatches(termPositions) : countWindowMatches(termPositions, window);
+    return matches > 0;
+}
+
+
+double PhraseCursor::score() const {
+    double total = 0.0;
+    for (const auto& term : terms) total += term->score();
+    return total;
+}
+
+
+int PhraseCursor::frequency() const {
+    int total = 0;
+    for (const auto& term : terms) total += term->frequency();
+    return total;
+}
+
+
+size_t PhraseCursor::cost() const {
+    size_t lowest = terms.empty() ? 0 : terms[0]->cost();
+    for (const auto& term : terms) lowest = std::min(lowest, term->cost());
+    return lowest;
+}
@@ -0,0 +1,152 @@
+#ifndef QUERY_CURSOR_H
+#define QUERY_CURSOR_H
+
+#include "InvertedIndex.h"
+#include "PositionalIndex.h"
+#include "AsyncIO.h"
+#include <climits>
+#include <memory>
+#include <vector>
+
+// Document-at-a-time cursor over the documents matching a (sub)query, in increasing docID order
+class QueryCursor {
+public:
+    static const int END = INT_MAX;
+
+    virtual ~QueryCursor() = default;
+
+    // Current document, or END once exhausted
+    virtual int docID() const = 0;
+
+    // Moves to the first matching document >= target; never moves backwards
+    virtual void nextGEQ(int target) = 0;
+
+    // TF-IDF contribution and summed term frequency of the current document
+    virtual double score() const = 0;
+    virtual int frequency() const = 0;
+
+    // Upper bound on the number of matches, used to drive intersections from the rarest cursor
+    virtual size_t cost() const = 0;
+
+    void next() { nextGEQ(docID() + 1); }
+};
+
+// Single term: gallops through the postings list and skips deleted documents
+class TermCursor : public QueryCursor {
+public:
+    TermCursor(const InvertedIndex& index, const std::wstring& term, double boost);
+
+    int docID() const override { return current; }
+    void nextGEQ(int target) override;
+    double score() const override;
+    int frequency() const override;
+    size_t cost() const override { return postings ? postings->size() : 0; }
+
+    // Position of the current posting inside the list (for positional lookups)
+    size_t postingIndex() const { return index; }
+
+private:
+    const InvertedIndex& invertedIndex;
+    const std::vector<Posting>* postings = nullptr;
+    size_t index = 0;
+    int current = END;
+    int docFreq = 0;
+    double boost;
+
+    void settle();
+};
+
+// Intersection (AND): every child must match; leapfrogs from the cheapest child
+class AndCursor : public QueryCursor {
+public:
+    explicit AndCursor(std::vector<std::unique_ptr<QueryCursor>> children);
+
+    int docID() const override { return current; }
+    void nextGEQ(int target) override;
+    double score() const override;
+    int frequency() const override;
+    size_t cost() const override { return children.empty() ? 0 : children.front()->cost(); }
+
+private:
+    std::vector<std::unique_ptr<QueryCursor>> children;
+    int current = -1;
+};
+
+// Union (OR): any child may match; scores add up over the children on the current document
+class OrCursor : public QueryCursor {
+public:
+    explicit OrCursor(std::vector<std::unique_ptr<QueryCursor>> children);
+
+    int docID() const override { return current; }
+    void nextGEQ(int target) override;
+    double score() const override;
+    int frequency() const override;
+    size_t cost() const override;
+
+private:
+    std::vector<std::unique_ptr<QueryCursor>> children;
+    int current = -1;
+};
+
+// Required/optional/excluded clauses. Matches come from the required cursor (or the
+// optional one when nothing is required); optional clauses only add score, and the
+// excluded cursor is moved with nextGEQ to each candidate instead of being scanned.
+class BooleanCursor : public QueryCursor {
+public:
+    BooleanCursor(std::unique_ptr<QueryCursor> required, std::unique_ptr<QueryCursor> optional,
+                  std::unique_ptr<QueryCursor> excluded);
+
+    int docID() const override { return positive->docID(); }
+    void nextGEQ(int target) override;
+    double score() const override;
+    int frequency() const override;
+    size_t cost() const override { return positive->cost(); }
+
+private:
+    std::unique_ptr<QueryCursor> required;
+    std::unique_ptr<QueryCursor> optional;
+    std::unique_ptr<QueryCursor> excluded;
+    QueryCursor* positive;
+};
+
+// Phrase or proximity window: an intersection of the terms filtered by their positions
+class PhraseCursor : public QueryCursor {
+public:
+    PhraseCursor(const InvertedIndex& index, const std::vector<std::wstring>& terms, int window, double boost);
+
+    int docID() const override { return current; }
+    void nextGEQ(int target) override;
+    double score() const override;
+    int frequency() const override;
+    size_t cost() const override;
+
+private:
+    std::vector<std::unique_ptr<TermCursor>> terms;
+    std::vector<std::unique_ptr<PositionListReader>> readers; // Created from blocks as each term's reads land
+    int window;
+    std::vector<std::string> blocks;
+    std::vector<size_t> readTerms;   // Term index of each read in batch
+    std::vector<size_t> pendingReads; // Reads of each term still in flight
+    std::unique_ptr<ReadBatch> batch;
+    int current = -1;
+
+    bool positionsMatch();
+};
+
+// Scales the score of a grouped subquery (e.g. "(a OR b)^2")
+class BoostCursor : public QueryCursor {
+public:
+    BoostCursor(std::unique_ptr<QueryCursor> child, double boost) : child(std::move(child)), boost(boost) {}
+
+    int docID() const override { return child->docID(); }
+    void nextGEQ(int target) override { child->nextGEQ(target); }
+    double score() const override { return boost * child->score(); }
+    int frequency() const override { return child->frequency(); }
+    size_t cost() const override { return child->cost(); }
+
+private:
+    std::unique_ptr<QueryCursor> child;
+    double boost;
+};
+
+#endif // QUERY_CURSOR_H
@@ -0,0 +1,256 @@
+#include "QueryParser.h"
+#include <cmath>
+#include <cwctype>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Token stream over the raw query text
+struct Token {
+    enum class Kind { Word, LParen, RParen, Quote, Plus, Minus, Caret, Tilde, End };
+    Kind kind;
+    std::wstring text;
+};
+
+std::vector<Token> tokenize(const std::wstring& query) {
+    std::vector<Token> tokens;
+    size_t i = 0;
+    while (i < query.size()) {
+        wchar_t ch = query[i];
+        if (std::iswspace(ch)) {
+            ++i;
+            continue;
+        }
+
+        Token::Kind kind = Token::Kind::Word;
+        switch (ch) {
+            case L'(': kind = Token::Kind::LParen; break;
+            case L')': kind = Token::Kind::RParen; break;
+            case L'"': kind = Token::Kind::Quote; break;
+            case L'+': kind = Token::Kind::Plus; break;
+            case L'-': kind = Token::Kind::Minus; break;
+            case L'^': kind = Token::Kind::Caret; break;
+            case L'~': kind = Token::Kind::Tilde; break;
+            default: break;
+        }
+
+        if (kind != Token::Kind::Word) {
+            tokens.push_back({kind, std::wstring(1, ch)});
+            ++i;
+            continue;
+        }
+
+        // A word runs until whitespace or an operator character
+        size_t start = i;
+        while (i < query.size() && !std::iswspace(query[i]) &&
+               query[i] != L'(' && query[i] != L')' && query[i] != L'"' && query[i] != L'^' && query[i] != L'~') {
+            ++i;
+        }
+        tokens.push_back({Token::Kind::Word, query.substr(start, i - start)});
+    }
+    tokens.push_back({Token::Kind::End, L""});
+    return tokens;
+}
+
+// Recursive-descent parser following the grammar in QueryParser.h
+class Parser {
+public:
+    Parser(std::vector<Token> tokens, bool defaultConjunctive, std::string& error)
+        : tokens(std::move(tokens)), defaultConjunctive(defaultConjunctive), error(error) {}
+
+    std::unique_ptr<QueryNode> parseQuery() {
+        auto node = parseOr();
+        if (node && peek().kind != Token::Kind::End) {
+            error = "unexpected input after end of query";
+            return nullptr;
+        }
+        return node;
+    }
+
+private:
+    std::vector<Token> tokens;
+    size_t pos = 0;
+    int depth = 0; // Open groups around the current position
+    bool defaultConjunctive;
+    std::string& error;
+
+    const Token& peek() const { return tokens[pos]; }
+    bool peekWord(const wchar_t* word) const { return peek().kind == Token::Kind::Word && peek().text == word; }
+
+    std::unique_ptr<QueryNode> parseOr() {
+        auto first = parseClauses();
+        if (!first) return nullptr;
+        if (!peekWord(L"OR")) return first;
+
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::Type::Or;
+        node->children.push_back(std::move(first));
+        while (peekWord(L"OR")) {
+            ++pos;
+            auto next = parseClauses();
+            if (!next) return nullptr;
+            node->children.push_back(std::move(next));
+        }
+        return node;
+    }
+
+    bool atClauseEnd() const {
+        Token::Kind kind = peek().kind;
+        return kind == Token::Kind::End || kind == Token::Kind::RParen || peekWord(L"OR");
+    }
+
+    std::unique_ptr<QueryNode> parseClauses() {
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::Type::Boolean;
+
+        // Plain clauses are collected first: an explicit AND next to them makes them required
+        std::vector<std::unique_ptr<QueryNode>> plain;
+        std::vector<bool> plainRequired;
+        bool nextRequired = false;
+
+        while (!atClauseEnd()) {
+            if (peekWord(L"AND")) {
+                ++pos;
+                if (!plainRequired.empty()) plainRequired.back() = true;
+                nextRequired = true;
+                continue;
+            }
+
+            enum { Plain, Required, Excluded } occur = Plain;
+            if (peek().kind == Token::Kind::Plus) {
+                occur = Required;
+                ++pos;
+            } else if (peek().kind == Token::Kind::Minus || peekWord(L"NOT")) {
+                occur = Excluded;
+                ++pos;
+            }
+
+            auto clause = parsePrimary();
+            if (!clause) return nullptr;
+
+            if (occur == Required) {
+                node->required.push_back(std::move(clause));
+            } else if (occur == Excluded) {
+                node->excluded.push_back(std::move(clause));
+            } else {
+                plain.push_back(std::move(clause));
+                plainRequired.push_back(nextRequired || defaultConjunctive);
+            }
+            nextRequired = false;
+        }
+
+        for (size_t i = 0; i < plain.size(); ++i) {
+            (plainRequired[i] ? node->required : node->optional).push_back(std::move(plain[i]));
+        }
+
+        if (node->required.empty() && node->optional.empty()) {
+            error = node->excluded.empty() ? "empty query or group" : "query needs at least one term that is not excluded";
+            return nullptr;
+        }
+
+        // A lone clause needs no Boolean wrapper
+        if (node->excluded.empty() && node->required.size() + node->optional.size() == 1) {
+            return std::move(node->required.empty() ? node->optional[0] : node->required[0]);
+        }
+        return node;
+    }
+
+    std::unique_ptr<QueryNode> parsePrimary() {
+        std::unique_ptr<QueryNode> node;
+
+        if (peek().kind == Token::Kind::LParen) {
+            // Each group is a level of recursion here and in the cursor tree built from it
+            if (depth >= QueryParser::maxDepth) {
+                error = "groups nested deeper than " + std::to_string(QueryParser::maxDepth) + " levels";
+                return nullptr;
+            }
+            ++pos;
+            ++depth;
+            node = parseOr();
+            --depth;
+            if (!node) return nullptr;
+            if (peek().kind != Token::Kind::RParen) {
+                error = "missing closing parenthesis";
+                return nullptr;
+            }
+            ++pos;
+        } else if (peek().kind == Token::Kind::Quote) {
+            ++pos;
+            node = std::make_unique<QueryNode>();
+            node->type = QueryNode::Type::Phrase;
+            while (peek().kind != Token::Kind::Quote) {
+                if (peek().kind == Token::Kind::End) {
+                    error = "missing closing quote";
+                    return nullptr;
+                }
+                // Operator characters inside quotes are ordinary text
+                if (peek().kind == Token::Kind::Word) node->terms.push_back(peek().text);
+                ++pos;
+            }
+            ++pos;
+            if (node->terms.empty()) {
+                error = "empty phrase";
+                return nullptr;
+            }
+            if (peek().kind == Token::Kind::Tilde) {
+                ++pos;
+                if (!parseNumber(node->window)) return nullptr;
+            }
+        } else if (peek().kind == Token::Kind::Word) {
+            node = std::make_unique<QueryNode>();
+            node->type = QueryNode::Type::Term;
+            node->terms.push_back(peek().text);
+            ++pos;
+        } else {
+            error = "expected a term, phrase or group";
+            return nullptr;
+        }
+
+        if (peek().kind == Token::Kind::Caret) {
+            ++pos;
+            double boost = 0.0;
+            if (!parseBoost(boost)) return nullptr;
+            node->boost *= boost;
+        }
+        return node;
+    }
+
+    bool parseNumber(int& value) {
+        try {
+            if (peek().kind != Token::Kind::Word) throw std::invalid_argument("number");
+            size_t used = 0;
+            value = std::stoi(peek().text, &used);
+            if (used != peek().text.size() || value < 0) throw std::invalid_argument("number");
+        } catch (const std::exception&) {
+            error = "expected a non-negative window size after ~";
+            return false;
+        }
+        ++pos;
+        return true;
+    }
+
+    bool parseBoost(double& value) {
+        try {
+            if (peek().kind != Token::Kind::Word) throw std::invalid_argument("boost");
+            size_t used = 0;
+            value = std::stod(peek().text, &used);
+            // nan or inf would make scores nan (not JSON, and unordered in the top-k heap)
+            if (used != peek().text.size() || !std::isfinite(value) || value <= 0.0) throw std::invalid_argument("boost");
+        } catch (const std::exception&) {
+            error = "expected a positive, finite boost factor after ^";
+            return false;
+        }
+        ++pos;
+        return true;
+    }
+};
+
+} // namespace
+
+QueryParser::QueryParser(bool defaultConjunctive) : defaultConjunctive(defaultConjunctive) {}
+
+std::unique_ptr<QueryNode> QueryParser::parse(const std::wstring& query, std::string& error) const {
+    Parser parser(tokenize(query), defaultConjunctive, error);
+    return parser.parseQuery();
+}
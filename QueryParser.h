@@ -0,0 +1,58 @@
+#ifndef QUERY_PARSER_H
+#define QUERY_PARSER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Node of a parsed structured query
+struct QueryNode {
+    enum class Type {
+        Term,     // single term
+        Phrase,   // "quoted terms", optionally "..."~window
+        Boolean,  // clauses with required (+, AND), optional and excluded (-, NOT) parts
+        Or        // a OR b OR ...
+    };
+
+    Type type = Type::Term;
+    double boost = 1.0;                         // term^2.5, (group)^2, "phrase"^3
+
+    // Term and Phrase
+    std::vector<std::wstring> terms;            // raw terms, preprocessed at evaluation time
+    int window = 0;                             // 0 = exact phrase, otherwise proximity span
+
+    // Boolean
+    std::vector<std::unique_ptr<QueryNode>> required;
+    std::vector<std::unique_ptr<QueryNode>> optional;
+    std::vector<std::unique_ptr<QueryNode>> excluded;
+
+    // Or
+    std::vector<std::unique_ptr<QueryNode>> children;
+};
+
+// Parses queries such as:  +apple -(banana OR cherry) "new york"~3 river^2
+//
+//   query   := orExpr
+//   orExpr  := clauses ('OR' clauses)*
+//   clauses := clause (['AND'] clause)*         adjacent clauses use the default operator
+//   clause  := ['+' | '-' | 'NOT'] primary
+//   primary := '(' orExpr ')' ['^' boost]
+//            | '"' term+ '"' ['~' window] ['^' boost]
+//            | term ['^' boost]
+//
+// Boosts must be positive and finite, windows non-negative, and groups nest at most maxDepth deep.
+class QueryParser {
+public:
+    static constexpr int maxDepth = 128;
+
+    // defaultConjunctive: plain adjacent clauses are all required (AND) instead of optional (OR)
+    explicit QueryParser(bool defaultConjunctive = false);
+
+    // Returns nullptr and sets error for malformed queries
+    std::unique_ptr<QueryNode> parse(const std::wstring& query, std::string& error) const;
+
+private:
+    bool defaultConjunctive;
+};
+
+#endif // QUERY_PARSER_H
@@ -1,9 +1,13 @@
 #include "QueryProcessor.h"
+#include "Metrics.h"
+#include "utils.h"
 #include <iostream>
 #include <string>
 #include <chrono>
 
-QueryProcessor::QueryProcessor(const InvertedIndex& index) : index(index) {}
+QueryProcessor::QueryProcessor(const InvertedIndex& index, bool explain) : index(&index), coordinator(nullptr), explain(explain) {}
+
+QueryProcessor::QueryProcessor(const ShardCoordinator& coordinator, bool explain) : index(nullptr), coordinator(&coordinator), explain(explain) {}
 
 void QueryProcessor::processQueries() const {
     std::wstring query;
@@ -12,16 +16,51 @@ void QueryProcessor::processQueries() const {
         std::getline(std::wcin, query);
         if (query.empty()) break;
 
-        std::wcout << L"Conjunctive or disjunctive (c/d): ";
+        // ":metrics" dumps the process-wide counters as Prometheus text, ":metrics json" as JSON
+        if (query == L":metrics" || query == L":metrics json") {
+            MetricsSnapshot snapshot = Metrics::snapshot();
+            std::wcout << utf8ToWstring(query == L":metrics" ? snapshot.toPrometheus() : snapshot.toJson() + "\n");
+            continue;
+        }
+
+        std::wcout << L"Conjunctive, disjunctive, phrase, window or structured (c/d/p/w/q): ";
         std::wstring type;
         std::getline(std::wcin, type);
         bool conjunctive = (type == L"c");
 
+        // Proximity queries need the maximum span of the matching window
+        int window = 0;
+        if (type == L"w") {
+            std::wcout << L"Window size: ";
+            std::wstring size;
+            std::getline(std::wcin, size);
+            try {
+                window = std::stoi(size);
+            } catch (const std::exception&) {
+                window = 0;
+            }
+            if (window <= 0) {
+                std::wcout << L"Invalid window size." << std::endl;
+                continue;
+            }
+        }
+
         // Start timing
+        MetricsSnapshot before = explain ? Metrics::snapshot() : MetricsSnapshot();
         auto start = std::chrono::high_resolution_clock::now();
 
         // Perform search with TF-IDF
-        auto results = index.searchWithTFIDF(query, conjunctive);
+        std::vector<SearchResult> results;
+        if (coordinator) {
+            results = coordinator->search(query, type, window);
+        } else if (type == L"p" || type == L"w") {
+            results = index->searchPhrase(query, window);
+        } else if (type == L"q") {
+            // e.g. +apple -(banana OR cherry) "new york"~3 river^2
+            results = index->searchQuery(query, false);
+        } else {
+            results = index->searchWithTFIDF(query, conjunctive);
+        }
 
         // End timing
         auto end = std::chrono::high_resolution_clock::now();
@@ -29,14 +68,19 @@ void QueryProcessor::processQueries() const {
 
         // Display query time
         std::wcout << L"Query processed in " << elapsed.count() << L" seconds." << std::endl;
+        if (explain) {
+            std::wcout << L"Profile: " << utf8ToWstring((Metrics::snapshot() - before).toJson()) << std::endl;
+        }
 
         // Display results
         if (results.empty()) {
             std::wcout << L"No results found for query." << std::endl;
         } else {
-            std::wcout << L"Top Results (DocID, Freq, TF-IDF):" << std::endl;
+            // Docnos, not internal docIDs, so results stay comparable across reorders and updates
+            std::wcout << L"Top Results (Docno, Freq, TF-IDF):" << std::endl;
             for (const auto& [docID, frequency, tfidf] : results) {
-                    std::wcout << L"DocID: " << docID << L", Frequency: " << frequency << L", TF-IDF: " << tfidf << std::endl;
+                    int docno = coordinator ? coordinator->docno(docID) : index->docno(docID);
+                    std::wcout << L"Docno: " << docno << L", Frequency: " << frequency << L", TF-IDF: " << tfidf << std::endl;
                 }
 
             }
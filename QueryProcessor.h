@@ -2,15 +2,21 @@
 #define QUERY_PROCESSOR_H
 
 #include "InvertedIndex.h"
+#include "ShardCoordinator.h"
 #include <string>
 
 class QueryProcessor {
 public:
-    QueryProcessor(const InvertedIndex& index);
+    // explain: print the per-query metrics (postings scanned, stage timings, ...) after each query
+    QueryProcessor(const InvertedIndex& index, bool explain = false);
+    // Queries a sharded index through its coordinator instead
+    QueryProcessor(const ShardCoordinator& coordinator, bool explain = false);
     void processQueries() const;
 
 private:
-    const InvertedIndex& index;
+    const InvertedIndex* index;
+    const ShardCoordinator* coordinator;
+    bool explain;
 };
 
 #endif
@@ -0,0 +1,648 @@
+#include "QueryServer.h"
+#include "Metrics.h"
+#include "utils.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+
+std::atomic<bool> QueryServer::stopRequested{false};
+
+struct QueryServer::Connection {
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { close(fd); }
+
+    int fd;
+    std::mutex writeMutex; // Workers of different batches may answer the same connection
+    bool broken = false;   // A write failed; later responses are dropped
+};
+
+namespace {
+
+struct JsonField {
+    bool isString;
+    std::string value; // Decoded UTF-8 for strings, the raw token otherwise
+};
+
+void appendUtf8(uint32_t codePoint, std::string& out) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+bool parseHex4(const std::string& text, size_t pos, uint32_t& value) {
+    if (pos + 4 > text.size()) return false;
+    value = 0;
+    for (size_t i = pos; i < pos + 4; ++i) {
+        char c = text[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+// Reads a JSON string starting at the opening quote; pos ends after the closing quote
+bool parseJsonString(const std::string& text, size_t& pos, std::string& out) {
+    ++pos;
+    while (pos < text.size()) {
+        char c = text[pos++];
+        if (c == '"') return true;
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (pos >= text.size()) return false;
+        char escape = text[pos++];
+        switch (escape) {
+            case '"': case '\\': case '/': out += escape; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t codePoint;
+                if (!parseHex4(text, pos, codePoint)) return false;
+                pos += 4;
+                // A high surrogate must be followed by its low half
+                uint32_t low;
+                if (codePoint >= 0xD800 && codePoint < 0xDC00 && text.compare(pos, 2, "\\u") == 0 &&
+                    parseHex4(text, pos + 2, low) && low >= 0xDC00 && low < 0xE000) {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    pos += 6;
+                }
+                // A lone surrogate has no UTF-8 encoding
+                if (codePoint >= 0xD800 && codePoint < 0xE000) return false;
+                appendUtf8(codePoint, out);
+                break;
+            }
+            default: return false;
+        }
+    }
+    return false;
+}
+
+void skipSpace(const std::string& text, size_t& pos) {
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) ++pos;
+}
+
+// Parses a flat JSON object whose members are strings, numbers, booleans or null
+bool parseFlatObject(const std::string& text, std::unordered_map<std::string, JsonField>& fields) {
+    size_t pos = 0;
+    skipSpace(text, pos);
+    if (pos >= text.size() || text[pos] != '{') return false;
+    ++pos;
+    skipSpace(text, pos);
+    if (pos < text.size() && text[pos] == '}') return true;
+
+    while (pos < text.size()) {
+        std::string key;
+        skipSpace(text, pos);
+        if (pos >= text.size() || text[pos] != '"' || !parseJsonString(text, pos, key)) return false;
+        skipSpace(text, pos);
+        if (pos >= text.size() || text[pos] != ':') return false;
+        ++pos;
+        skipSpace(text, pos);
+        if (pos >= text.size()) return false;
+
+        JsonField field;
+        if (text[pos] == '"') {
+            field.isString = true;
+            if (!parseJsonString(text, pos, field.value)) return false;
+        } else {
+            field.isString = false;
+            size_t end = pos;
+            while (end < text.size() && text[end] != ',' && text[end] != '}' &&
+                   !std::isspace(static_cast<unsigned char>(text[end]))) ++end;
+            field.value = text.substr(pos, end - pos);
+            pos = end;
+
+            // Nested objects and arrays are not part of the protocol
+            const std::string& token = field.value;
+            char* parsedEnd = nullptr;
+            bool isNumber = !token.empty() && (std::strtod(token.c_str(), &parsedEnd), *parsedEnd == '\0');
+            if (!isNumber && token != "true" && token != "false" && token != "null") return false;
+        }
+        fields[key] = field;
+
+        skipSpace(text, pos);
+        if (pos >= text.size()) return false;
+        if (text[pos] == '}') {
+            ++pos;
+            skipSpace(text, pos);
+            return pos == text.size();
+        }
+        if (text[pos] != ',') return false;
+        ++pos;
+    }
+    return false;
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// Integer member in [minValue, maxValue]; absent members keep value
+bool readInt(const std::unordered_map<std::string, JsonField>& fields, const std::string& key,
+             long minValue, long maxValue, long& value) {
+    auto field = fields.find(key);
+    if (field == fields.end() || (!field->second.isString && field->second.value == "null")) return true;
+    if (field->second.isString) return false;
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(field->second.value.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || parsed < minValue || parsed > maxValue) return false;
+    value = parsed;
+    return true;
+}
+
+std::string errorBody(const std::string& id, const std::string& status, const std::string& message) {
+    return "{\"id\": " + id + ", \"status\": \"" + status + "\", \"error\": " + jsonEscape(message) + "}";
+}
+
+bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+
+QueryServer::QueryServer(const InvertedIndex& index, const QueryServerOptions& options)
+    : index(&index), coordinator(nullptr), options(options) {}
+
+
+QueryServer::QueryServer(const ShardCoordinator& coordinator, const QueryServerOptions& options)
+    : index(nullptr), coordinator(&coordinator), options(options) {}
+
+
+QueryServer::~QueryServer() {
+    // Only does work if run() never got to shut down itself
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    if (listenFd >= 0) close(listenFd);
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+}
+
+
+bool QueryServer::start() {
+    const std::string& listen = options.listen;
+    if (listen.rfind("unix:", 0) == 0) {
+        std::string path = listen.substr(5);
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            std::cerr << " ERROR: Invalid Unix socket path " << path << std::endl;
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+
+        // A socket left behind by a previous run is replaced; any other file is not touched
+        struct stat info;
+        if (lstat(path.c_str(), &info) == 0) {
+            if (!S_ISSOCK(info.st_mode)) {
+                std::cerr << " ERROR: " << path << " exists and is not a socket" << std::endl;
+                return false;
+            }
+            unlink(path.c_str());
+        }
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::cerr << " ERROR: Could not bind " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        unixPath = path;
+    } else if (listen.rfind("tcp:", 0) == 0) {
+        char* end = nullptr;
+        long port = std::strtol(listen.c_str() + 4, &end, 10);
+        if (*end != '\0' || port <= 0 || port > 65535) {
+            std::cerr << " ERROR: Invalid TCP port in " << listen << std::endl;
+            return false;
+        }
+
+        // Loopback only: the protocol has no authentication
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (listenFd >= 0) setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::cerr << " ERROR: Could not bind 127.0.0.1:" << port << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    } else {
+        std::cerr << " ERROR: --listen expects unix:<path> or tcp:<port>, got " << listen << std::endl;
+        return false;
+    }
+
+    if (::listen(listenFd, SOMAXCONN) < 0) {
+        std::cerr << " ERROR: listen() failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    int numWorkers = options.workers > 0 ? options.workers
+                                         : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 0; i < numWorkers; ++i) {
+        workers.emplace_back(&QueryServer::workerLoop, this);
+    }
+    std::cout << " Listening on " << listen << " with " << numWorkers << " workers" << std::endl;
+    return true;
+}
+
+
+void QueryServer::requestStop() {
+    stopRequested.store(true);
+}
+
+
+void QueryServer::run() {
+    while (!stopRequested.load()) {
+        // Short poll timeout, so a stop request is noticed without a wake-up from the signal handler
+        pollfd listening = {listenFd, POLLIN, 0};
+        int ready = poll(&listening, 1, 200);
+        joinFinishedSessions();
+        if (ready <= 0) continue;
+
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        if (unixPath.empty()) {
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+
+        sessions.emplace_back();
+        Session& session = sessions.back();
+        session.connection = std::make_shared<Connection>(fd);
+        session.reader = std::thread(&QueryServer::readRequests, this, std::ref(session));
+    }
+
+    std::cout << " Shutting down query server..." << std::endl;
+    close(listenFd);
+    listenFd = -1;
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+    unixPath.clear();
+
+    // Stop reading new requests, but answer everything already queued
+    for (auto& session : sessions) shutdown(session.connection->fd, SHUT_RD);
+    for (auto& session : sessions) session.reader.join();
+    sessions.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+
+    std::cout << " Served " << served.load() << " requests (" << timedOut.load() << " timed out, "
+              << rejected.load() << " rejected)." << std::endl;
+}
+
+
+void QueryServer::joinFinishedSessions() {
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if (it->finished.load()) {
+            it->reader.join();
+            it = sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+
+void QueryServer::readRequests(Session& session) {
+    int fd = session.connection->fd;
+    std::string pending;
+    std::vector<char> buffer(64 * 1024);
+    bool open = true;
+
+    while (open) {
+        ssize_t n = recv(fd, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pending.append(buffer.data(), static_cast<size_t>(n));
+
+        // Every complete frame in the buffer is queued at once; that is what makes pipelining cheap
+        size_t pos = 0;
+        while (open && pos < pending.size()) {
+            Request request;
+            request.connection = session.connection;
+            std::string frame;
+
+            if (pending[pos] == '\0') {
+                if (pending.size() - pos < 5) break;
+                uint32_t length = 0;
+                for (size_t i = 1; i <= 4; ++i) length = (length << 8) | static_cast<unsigned char>(pending[pos + i]);
+                request.binary = true;
+                if (length > options.maxRequestBytes) {
+                    respond(request, errorBody("null", "error", "request too large"));
+                    open = false;
+                    break;
+                }
+                if (pending.size() - pos - 5 < length) break;
+                frame = pending.substr(pos + 5, length);
+                pos += 5 + length;
+            } else {
+                size_t end = pending.find('\n', pos);
+                if (end == std::string::npos) {
+                    if (pending.size() - pos > options.maxRequestBytes) {
+                        respond(request, errorBody("null", "error", "request too large"));
+                        open = false;
+                    }
+                    break;
+                }
+                frame = pending.substr(pos, end - pos);
+                pos = end + 1;
+                if (!frame.empty() && frame.back() == '\r') frame.pop_back();
+                if (frame.find_first_not_of(" \t") == std::string::npos) continue;
+            }
+
+            request.arrival = std::chrono::steady_clock::now();
+            METRIC_ADD(ServerRequests, 1);
+            std::string error;
+            if (!parseRequest(frame, request, error)) {
+                rejected++;
+                respond(request, errorBody(request.id, "error", error));
+                continue;
+            }
+
+            // Same counters as the interactive ":metrics" command, answered without queueing
+            if (request.query == L":metrics") {
+                respond(request, "{\"id\": " + request.id + ", \"status\": \"ok\", \"metrics\": " +
+                                 Metrics::snapshot().toJson() + "}");
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                queue.push_back(std::move(request));
+            }
+            queueReady.notify_one();
+        }
+        pending.erase(0, pos);
+    }
+    session.finished.store(true);
+}
+
+
+bool QueryServer::parseRequest(const std::string& frame, Request& request, std::string& error) const {
+    std::unordered_map<std::string, JsonField> fields;
+    if (!parseFlatObject(frame, fields)) {
+        error = "malformed request: expected a flat JSON object";
+        return false;
+    }
+
+    // Raw bytes are copied into strings unchecked; invalid UTF-8 must not reach the response or the
+    // converter, whose std::range_error would otherwise escape the reader thread
+    auto isUtf8 = [](const std::string& text) {
+        try {
+            utf8ToWstring(text);
+            return true;
+        } catch (const std::range_error&) {
+            return false;
+        }
+    };
+
+    auto id = fields.find("id");
+    if (id != fields.end()) {
+        if (id->second.isString && !isUtf8(id->second.value)) {
+            error = "id is not valid UTF-8";
+            return false;
+        }
+        request.id = id->second.isString ? jsonEscape(id->second.value) : id->second.value;
+    }
+
+    auto query = fields.find("q");
+    if (query == fields.end() || !query->second.isString || query->second.value.empty()) {
+        error = "missing query string \"q\"";
+        return false;
+    }
+    if (!isUtf8(query->second.value)) {
+        error = "q is not valid UTF-8";
+        return false;
+    }
+    request.query = utf8ToWstring(query->second.value);
+
+    auto mode = fields.find("mode");
+    if (mode != fields.end()) {
+        const std::string& value = mode->second.value;
+        if (!mode->second.isString || (value != "c" && value != "d" && value != "p" && value != "w" && value != "q")) {
+            error = "mode must be one of c, d, p, w, q";
+            return false;
+        }
+        request.mode = utf8ToWstring(value);
+    }
+
+    long k = 20;
+    long window = 0;
+    long deadlineMs = options.defaultDeadlineMs;
+    if (!readInt(fields, "k", 1, 1000, k)) {
+        error = "k must be an integer in [1, 1000]";
+        return false;
+    }
+    if (!readInt(fields, "window", 1, 100000, window)) {
+        error = "window must be a positive integer";
+        return false;
+    }
+    if (!readInt(fields, "deadline_ms", 0, 3600000, deadlineMs)) {
+        error = "deadline_ms must be a non-negative integer";
+        return false;
+    }
+    if (request.mode == L"w" && window <= 0) {
+        error = "mode w needs a window";
+        return false;
+    }
+    // Only the cursor engine ranks an arbitrary top k; the other modes rank a fixed top 20
+    if (request.mode != L"q" && k > 20) {
+        error = "k above 20 is only supported in mode q";
+        return false;
+    }
+
+    request.k = static_cast<size_t>(k);
+    request.window = (request.mode == L"w") ? static_cast<int>(window) : 0;
+    request.deadline = (deadlineMs > 0) ? request.arrival + std::chrono::milliseconds(deadlineMs)
+                                        : std::chrono::steady_clock::time_point::max();
+    return true;
+}
+
+
+void QueryServer::workerLoop() {
+    while (true) {
+        std::vector<Request> batch;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+
+            // An even share of the backlog, so one worker does not hoard a burst the others could run
+            size_t share = (queue.size() + workers.size() - 1) / workers.size();
+            size_t take = std::min(options.maxBatch, std::max<size_t>(1, share));
+            for (size_t i = 0; i < take; ++i) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+        METRIC_ADD(ServerBatches, 1);
+        processBatch(batch);
+    }
+}
+
+
+void QueryServer::processBatch(std::vector<Request>& batch) {
+    [[maybe_unused]] auto now = std::chrono::steady_clock::now();
+
+    // Identical queries (same text, mode, window and k) run once for the whole batch
+    std::vector<std::vector<const Request*>> groups;
+    std::unordered_map<std::wstring, size_t> groupOf;
+    for (const auto& request : batch) {
+        METRIC_STAGE_NANOS(QueueWait, std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.arrival).count());
+        std::wstring key = request.mode + L'\x1f' + std::to_wstring(request.window) + L'\x1f' +
+                           std::to_wstring(request.k) + L'\x1f' + request.query;
+        auto inserted = groupOf.emplace(key, groups.size());
+        if (inserted.second) groups.emplace_back();
+        groups[inserted.first->second].push_back(&request);
+    }
+
+    auto timeout = [this](const Request& request) {
+        timedOut++;
+        METRIC_ADD(ServerTimeouts, 1);
+        respond(request, errorBody(request.id, "timeout", "deadline exceeded"));
+    };
+
+    for (const auto& group : groups) {
+        // A running search cannot be interrupted, so deadlines are checked before and after it
+        std::vector<const Request*> live;
+        auto start = std::chrono::steady_clock::now();
+        for (const Request* request : group) {
+            if (start >= request->deadline) timeout(*request);
+            else live.push_back(request);
+        }
+        if (live.empty()) continue;
+
+        std::vector<SearchResult> results = search(*live.front());
+        auto end = std::chrono::steady_clock::now();
+
+        std::ostringstream resultsJson;
+        resultsJson << std::setprecision(9);
+        for (size_t i = 0; i < results.size(); ++i) {
+            int docno = coordinator ? coordinator->docno(results[i].docID) : index->docno(results[i].docID);
+            resultsJson << (i ? ", " : "") << "{\"docno\": " << docno << ", \"freq\": "
+                        << results[i].frequency << ", \"score\": " << results[i].tfidf << "}";
+        }
+        std::string resultsText = resultsJson.str();
+
+        for (const Request* request : live) {
+            if (end > request->deadline) {
+                timeout(*request);
+                continue;
+            }
+            auto took = std::chrono::duration_cast<std::chrono::microseconds>(end - request->arrival).count();
+            served++;
+            respond(*request, "{\"id\": " + request->id + ", \"status\": \"ok\", \"took_us\": " +
+                              std::to_string(took) + ", \"results\": [" + resultsText + "]}");
+        }
+    }
+}
+
+
+std::vector<SearchResult> QueryServer::search(const Request& request) const {
+    // Same dispatch as QueryProcessor; c/d/p/w rank a fixed top 20 (parseRequest caps k there), q honours k
+    std::vector<SearchResult> results;
+    if (coordinator) {
+        results = coordinator->search(request.query, request.mode, request.window, request.k);
+    } else if (request.mode == L"p" || request.mode == L"w") {
+        results = index->searchPhrase(request.query, request.window);
+    } else if (request.mode == L"q") {
+        results = index->searchQuery(request.query, false, request.k);
+    } else {
+        results = index->searchWithTFIDF(request.query, request.mode == L"c");
+    }
+    if (results.size() > request.k) results.resize(request.k);
+    return results;
+}
+
+
+void QueryServer::respond(const Request& request, const std::string& body) {
+    std::string frame;
+    if (request.binary) {
+        uint32_t length = static_cast<uint32_t>(body.size());
+        frame += '\0';
+        for (int shift = 24; shift >= 0; shift -= 8) frame += static_cast<char>((length >> shift) & 0xFF);
+        frame += body;
+    } else {
+        frame = body + "\n";
+    }
+
+    Connection& connection = *request.connection;
+    std::lock_guard<std::mutex> lock(connection.writeMutex);
+    if (connection.broken) return;
+    if (!sendAll(connection.fd, frame)) connection.broken = true;
+}
@@ -0,0 +1,107 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include "InvertedIndex.h"
+#include "ShardCoordinator.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct QueryServerOptions {
+    std::string listen;          // "unix:<path>" or "tcp:<port>" (bound to 127.0.0.1 only)
+    int workers = 0;             // Search threads; 0 = one per hardware thread
+    size_t maxBatch = 32;        // Requests a worker takes off the queue at once
+    int defaultDeadlineMs = 0;   // Used when a request has no deadline_ms; 0 = none
+    size_t maxRequestBytes = 1 << 20;
+};
+
+// Long-running query daemon over a loopback socket. Each request is one JSON object, either on
+// its own line or, for clients that prefer binary framing, preceded by a zero byte and a 4-byte
+// big-endian length (the first byte of a JSON line is never zero). The response uses the framing
+// of its request:
+//   {"id": 7, "q": "new york", "mode": "d", "k": 10, "deadline_ms": 50}
+//   {"id": 7, "status": "ok", "took_us": 412, "results": [{"docno": 3, "freq": 2, "score": 0.31}, ...]}
+// A connection may pipeline any number of requests; responses are written as they finish, so
+// clients match them by id. Requests of all connections share one queue that the workers drain
+// in micro-batches, running identical queries of a batch only once.
+class QueryServer {
+public:
+    QueryServer(const InvertedIndex& index, const QueryServerOptions& options);
+    QueryServer(const ShardCoordinator& coordinator, const QueryServerOptions& options);
+    ~QueryServer();
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Binds the socket and starts the workers; false (with an error printed) if listen is invalid
+    bool start();
+
+    // Accepts connections until requestStop(), then drains queued requests and returns
+    void run();
+
+    // Async-signal-safe, so it can be called from a SIGINT/SIGTERM handler
+    static void requestStop();
+
+private:
+    struct Connection;
+
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        bool binary = false;
+        std::string id = "null"; // Echoed verbatim (JSON number or string)
+        std::wstring query;
+        std::wstring mode = L"d";
+        int window = 0;
+        size_t k = 20;
+        std::chrono::steady_clock::time_point arrival;
+        std::chrono::steady_clock::time_point deadline; // time_point::max() when there is none
+    };
+
+    struct Session {
+        std::shared_ptr<Connection> connection;
+        std::thread reader;
+        std::atomic<bool> finished{false};
+    };
+
+    // Splits a connection's byte stream into frames and queues their requests
+    void readRequests(Session& session);
+
+    // Parses one frame; on failure the error is answered directly and false is returned
+    bool parseRequest(const std::string& frame, Request& request, std::string& error) const;
+
+    void workerLoop();
+    void processBatch(std::vector<Request>& batch);
+    std::vector<SearchResult> search(const Request& request) const;
+
+    static void respond(const Request& request, const std::string& body);
+    void joinFinishedSessions();
+
+    const InvertedIndex* index;
+    const ShardCoordinator* coordinator;
+    QueryServerOptions options;
+
+    int listenFd = -1;
+    std::string unixPath; // Removed again on shutdown
+
+    std::list<Session> sessions; // Only touched by the thread in run()
+    std::vector<std::thread> workers;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<Request> queue;
+    bool stopping = false;
+
+    std::atomic<uint64_t> served{0};
+    std::atomic<uint64_t> timedOut{0};
+    std::atomic<uint64_t> rejected{0};
+
+    static std::atomic<bool> stopRequested;
+};
+
+#endif // QUERY_SERVER_H
@@ -0,0 +1,213 @@
+#include "ShardCoordinator.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+
+namespace {
+
+// Same order as every single-index search: score, then lower docID
+bool betterResult(const SearchResult& a, const SearchResult& b) {
+    return a.tfidf > b.tfidf || (a.tfidf == b.tfidf && a.docID < b.docID);
+}
+
+} // namespace
+
+
+ShardCoordinator::~ShardCoordinator() {
+    for (auto& worker : workers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stopping = true;
+        }
+        worker->ready.notify_one();
+        worker->thread.join();
+    }
+}
+
+
+bool ShardCoordinator::open(const std::string& indexPath, int numShards) {
+    for (int i = 0; i < numShards; ++i) {
+        auto shard = std::make_unique<InvertedIndex>();
+        std::cout << " Loading shard " << i << "..." << std::endl;
+        if (!shard->loadIndex(shardPath(indexPath, i))) return false;
+        if (!shard->loadGlobalStats(indexPath + "/global_stats.dat")) return false;
+        shard->setVerbose(false);
+        shards.push_back(std::move(shard));
+    }
+
+    // One long-lived worker per shard, so a query costs no thread start-up
+    for (int i = 0; i < numShards; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        Worker* worker = workers.back().get();
+        worker->thread = std::thread([worker]() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(worker->mutex);
+                    worker->ready.wait(lock, [worker]() { return worker->stopping || !worker->tasks.empty(); });
+                    if (worker->tasks.empty()) return;
+                    task = std::move(worker->tasks.front());
+                    worker->tasks.pop_front();
+                }
+                task();
+            }
+        });
+    }
+    return true;
+}
+
+
+void ShardCoordinator::forEachShard(const std::function<void(const InvertedIndex&, size_t)>& task) const {
+    std::mutex doneMutex;
+    std::condition_variable allDone;
+    size_t pending = shards.size();
+
+    for (size_t i = 0; i < shards.size(); ++i) {
+        Worker& worker = *workers[i];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back([&, i]() {
+                task(*shards[i], i);
+                std::lock_guard<std::mutex> doneLock(doneMutex);
+                if (--pending == 0) allDone.notify_one();
+            });
+        }
+        worker.ready.notify_one();
+    }
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    allDone.wait(lock, [&]() { return pending == 0; });
+}
+
+
+std::vector<SearchResult> ShardCoordinator::search(const std::wstring& query, const std::wstring& type, int window, size_t k) const {
+    std::vector<std::vector<SearchResult>> shardResults(shards.size());
+
+    if (type == L"p" || type == L"w") {
+        // Phrase df is only known after matching, so match everywhere first and score with the total
+        std::vector<std::vector<std::pair<int, int>>> shardMatches(shards.size());
+        forEachShard([&](const InvertedIndex& shard, size_t i) {
+            shardMatches[i] = shard.matchPhrase(query, window);
+        });
+
+        int phraseDocFreq = 0;
+        for (const auto& matches : shardMatches) phraseDocFreq += static_cast<int>(matches.size());
+
+        forEachShard([&](const InvertedIndex& shard, size_t i) {
+            shardResults[i] = shard.scorePhraseMatches(shardMatches[i], phraseDocFreq);
+        });
+        k = 20;
+    } else if (type == L"q") {
+        forEachShard([&](const InvertedIndex& shard, size_t i) {
+            shardResults[i] = shard.searchQuery(query, false, k);
+        });
+    } else {
+        // Each shard's top 20 holds every document of the global top 20 that lives on it
+        bool conjunctive = (type == L"c");
+        forEachShard([&](const InvertedIndex& shard, size_t i) {
+            shardResults[i] = shard.searchWithTFIDF(query, conjunctive);
+        });
+        k = 20;
+    }
+
+    std::vector<SearchResult> results;
+    for (auto& partial : shardResults) {
+        results.insert(results.end(), partial.begin(), partial.end());
+    }
+    std::sort(results.begin(), results.end(), betterResult);
+    if (results.size() > k) results.resize(k);
+    return results;
+}
+
+
+int ShardCoordinator::docno(int docID) const {
+    // Shards own contiguous docID ranges, so the one that has the document in its doc table holds it
+    for (const auto& shard : shards) {
+        if (shard->hasDocument(docID)) return shard->docno(docID);
+    }
+    return docID;
+}
+
+
+void ShardCoordinator::setTierMode(TierMode mode) {
+    for (auto& shard : shards) shard->setTierMode(mode);
+}
+
+
+TierStats ShardCoordinator::tierStats() const {
+    TierStats total;
+    for (const auto& shard : shards) {
+        TierStats stats = shard->tierStats();
+        total.served += stats.served;
+        total.fallbacks += stats.fallbacks;
+    }
+    return total;
+}
+
+
+std::string ShardCoordinator::shardPath(const std::string& indexPath, int shard) {
+    return indexPath + "/shard_" + std::to_string(shard);
+}
+
+
+std::vector<std::unordered_map<int, std::wstring>> ShardCoordinator::partitionDocuments(
+    const std::unordered_map<int, std::wstring>& documents, int numShards) {
+    std::vector<int> docIDs;
+    docIDs.reserve(documents.size());
+    for (const auto& doc : documents) docIDs.push_back(doc.first);
+    std::sort(docIDs.begin(), docIDs.end());
+
+    // DocIDs stay global, so results from different shards never collide
+    std::vector<std::unordered_map<int, std::wstring>> partitions(numShards);
+    for (size_t i = 0; i < docIDs.size(); ++i) {
+        size_t shard = i * numShards / docIDs.size();
+        partitions[shard].emplace(docIDs[i], documents.at(docIDs[i]));
+    }
+    return partitions;
+}
+
+
+bool ShardCoordinator::writeGlobalStats(const std::string& indexPath, int numShards) {
+    std::map<std::string, long long> docFreqs;
+    long long numDocs = 0;
+    for (int i = 0; i < numShards; ++i) {
+        // N counts indexed documents, like docLengths in a single index (empty documents are skipped);
+        // a docID can be listed by several chunks, so count distinct IDs
+        std::ifstream docLengthsFile(shardPath(indexPath, i) + "/final_doclengths.dat");
+        std::unordered_set<int> docIDs;
+        int docID, docLength;
+        while (docLengthsFile >> docID >> docLength) docIDs.insert(docID);
+        numDocs += static_cast<long long>(docIDs.size());
+
+        std::ifstream indexFile(shardPath(indexPath, i) + "/final_index.dat");
+        if (!indexFile.is_open()) {
+            std::cerr << " ERROR: Could not open final index of shard " << i << std::endl;
+            return false;
+        }
+
+        // Each line starts with "term df"; the postings themselves are not needed
+        std::string line;
+        while (std::getline(indexFile, line)) {
+            std::istringstream iss(line);
+            std::string term;
+            long long docFreq;
+            if (iss >> term >> docFreq) docFreqs[term] += docFreq;
+        }
+    }
+
+    std::string path = indexPath + "/global_stats.dat";
+    std::ofstream statsFile(path, std::ios::trunc);
+    if (!statsFile.is_open()) {
+        std::cerr << " ERROR: Could not write global statistics " << path << std::endl;
+        return false;
+    }
+    statsFile << "num_docs " << numDocs << "\n";
+    for (const auto& [term, docFreq] : docFreqs) {
+        statsFile << term << " " << docFreq << "\n";
+    }
+    std::cout << " Global statistics: " << numDocs << " documents, " << docFreqs.size() << " terms" << std::endl;
+    return true;
+}
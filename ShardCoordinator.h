@@ -0,0 +1,68 @@
+#ifndef SHARD_COORDINATOR_H
+#define SHARD_COORDINATOR_H
+
+#include "InvertedIndex.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Serves an index built as N docID-partitioned shards (index_dir/shard_<i>/). Every shard is a
+// complete index loaded with the collection-wide N and df from index_dir/global_stats.dat, so a
+// document scores exactly as in a single index; a query is fanned out to one worker thread per
+// shard and the per-shard result lists are merged.
+class ShardCoordinator {
+public:
+    ShardCoordinator() = default;
+    ~ShardCoordinator();
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    // Loads all shards and starts their workers
+    bool open(const std::string& indexPath, int numShards);
+
+    // Same modes and result order as the single-index searches:
+    // c/d = searchWithTFIDF, p/w = searchPhrase (window > 0 for w), q = searchQuery with top k
+    std::vector<SearchResult> search(const std::wstring& query, const std::wstring& type, int window, size_t k = 20) const;
+
+    size_t numShards() const { return shards.size(); }
+
+    // Docno of a docID, looked up in the shard that holds it
+    int docno(int docID) const;
+
+    // Applies to every shard; stats are summed over shards (each shard decides on its own)
+    void setTierMode(TierMode mode);
+    TierStats tierStats() const;
+
+    // Directory of shard i inside a sharded index
+    static std::string shardPath(const std::string& indexPath, int shard);
+
+    // Splits documents into numShards contiguous docID ranges of near-equal size
+    static std::vector<std::unordered_map<int, std::wstring>> partitionDocuments(
+        const std::unordered_map<int, std::wstring>& documents, int numShards);
+
+    // Sums N and each term's df over the shards' final indexes into indexPath/global_stats.dat
+    static bool writeGlobalStats(const std::string& indexPath, int numShards);
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::function<void()>> tasks;
+        bool stopping = false;
+    };
+
+    // Runs task(shard) on every shard's worker and waits for all of them
+    void forEachShard(const std::function<void(const InvertedIndex&, size_t)>& task) const;
+
+    std::vector<std::unique_ptr<InvertedIndex>> shards;
+    std::vector<std::unique_ptr<Worker>> workers;
+};
+
+#endif // SHARD_COORDINATOR_H
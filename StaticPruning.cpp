@@ -0,0 +1,75 @@
+#include "StaticPruning.h"
+#include "InvertedIndex.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+bool buildTier1(const std::string& indexPath, int postingsPerTerm, PruningStats& stats) {
+    auto start = std::chrono::high_resolution_clock::now();
+    stats = PruningStats();
+
+    std::ifstream indexFile(indexPath + "/final_index.dat");
+    if (!indexFile.is_open()) {
+        std::cerr << " ERROR: No final_index.dat in " << indexPath << std::endl;
+        return false;
+    }
+
+    // Written under temporary names so a failed build never leaves a tier 1 that disagrees with tier 2
+    std::string tierPath = indexPath + "/tier1_index.dat";
+    std::string cutoffsPath = indexPath + "/tier1_cutoffs.dat";
+    std::ofstream tierOut(tierPath + ".tmp", std::ios::trunc);
+    std::ofstream cutoffsOut(cutoffsPath + ".tmp", std::ios::trunc);
+    if (!tierOut.is_open() || !cutoffsOut.is_open()) {
+        std::cerr << " ERROR: Could not write tier 1 files in " << indexPath << std::endl;
+        return false;
+    }
+
+    std::string line;
+    std::wstring term;
+    std::vector<Posting> postings;
+    while (std::getline(indexFile, line)) {
+        if (line.empty() || !InvertedIndex::parsePostingsLine(line, term, postings)) continue;
+        stats.numTerms++;
+        stats.fullPostings += postings.size();
+
+        std::string utf8Term = wstringToUtf8(term);
+        if (postings.size() > static_cast<size_t>(postingsPerTerm)) {
+            // Highest frequency first, lower docID on ties, then back to docID order for binary search
+            auto higherImpact = [](const Posting& a, const Posting& b) {
+                return a.frequency > b.frequency || (a.frequency == b.frequency && a.docID < b.docID);
+            };
+            std::nth_element(postings.begin(), postings.begin() + postingsPerTerm, postings.end(), higherImpact);
+            int cutoffFreq = 0;
+            for (size_t i = postingsPerTerm; i < postings.size(); ++i) cutoffFreq = std::max(cutoffFreq, postings[i].frequency);
+            postings.resize(postingsPerTerm);
+            std::sort(postings.begin(), postings.end(), [](const Posting& a, const Posting& b) { return a.docID < b.docID; });
+
+            cutoffsOut << utf8Term << " " << cutoffFreq << "\n";
+            stats.prunedTerms++;
+        }
+        stats.tier1Postings += postings.size();
+
+        tierOut << utf8Term << " " << postings.size() << " ";
+        for (const auto& p : postings) tierOut << p.docID << " ";
+        for (const auto& p : postings) tierOut << p.frequency << " ";
+        tierOut << "\n";
+    }
+    tierOut.close();
+    cutoffsOut.close();
+
+    if (std::rename((tierPath + ".tmp").c_str(), tierPath.c_str()) != 0 ||
+        std::rename((cutoffsPath + ".tmp").c_str(), cutoffsPath.c_str()) != 0) {
+        std::cerr << " ERROR: Could not install tier 1 files in " << indexPath << std::endl;
+        return false;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    std::cout << " Built tier 1 in " << elapsed.count() << " seconds: " << stats.tier1Postings << " of "
+              << stats.fullPostings << " postings kept, " << stats.prunedTerms << " of " << stats.numTerms
+              << " terms pruned to " << postingsPerTerm << " postings." << std::endl;
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef STATIC_PRUNING_H
+#define STATIC_PRUNING_H
+
+#include <cstdint>
+#include <string>
+
+// Outcome of building the pruned first tier
+struct PruningStats {
+    int numTerms = 0;
+    int prunedTerms = 0;       // terms whose list was cut to postingsPerTerm entries
+    uint64_t fullPostings = 0;
+    uint64_t tier1Postings = 0;
+};
+
+// Writes tier 1 of a two-tier index next to the main index in indexPath: for each term its
+// postingsPerTerm highest-impact postings (tier1_index.dat, same line format as final_index.dat)
+// and, for lists that were cut, the largest frequency left out (tier1_cutoffs.dat: "term freq").
+// A term's TF-IDF contribution grows with its frequency, so the top postings by frequency are
+// the top postings by score, and the left-out frequency bounds every pruned posting's score.
+// The full final_index.dat stays untouched and serves as tier 2.
+bool buildTier1(const std::string& indexPath, int postingsPerTerm, PruningStats& stats);
+
+#endif // STATIC_PRUNING_H
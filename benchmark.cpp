@@ -0,0 +1,568 @@
+// Reproducible benchmark suite: microbenchmarks of the hot paths plus an end-to-end run that
+// indexes a synthetic Zipf-distributed corpus generated from a fixed seed and replays a query set.
+// Results are written as one JSON object so runs of different versions can be diffed.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <cwctype>
+#include <functional>
+#include <unordered_set>
+#include <cstdio>
+#include <iomanip>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "DocumentParser.h"
+#include "InvertedIndex.h"
+#include "PositionalIndex.h"
+#include "QueryServer.h"
+#include "StaticPruning.h"
+#include "utils.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The library reports progress on cout/wcout; muting them keeps that I/O out of the timings
+struct MuteOutput {
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    std::wstreambuf* wout = std::wcout.rdbuf(nullptr);
+    ~MuteOutput() {
+        std::cout.rdbuf(out);
+        std::wcout.rdbuf(wout);
+        std::cout.clear();
+        std::wcout.clear();
+    }
+};
+
+// Draws term ranks following Zipf's law (exponent s) over a fixed vocabulary
+class ZipfSampler {
+public:
+    ZipfSampler(int vocabularySize, double s) : cdf(vocabularySize) {
+        double total = 0.0;
+        for (int rank = 0; rank < vocabularySize; ++rank) {
+            total += 1.0 / std::pow(rank + 1, s);
+            cdf[rank] = total;
+        }
+        for (double& value : cdf) value /= total;
+    }
+
+    int operator()(std::mt19937& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+// Vocabulary words are letters only, so preprocessing leaves them untouched
+static std::string termForRank(int rank) {
+    std::string term = "t";
+    do {
+        term += static_cast<char>('a' + rank % 26);
+        rank /= 26;
+    } while (rank > 0);
+    return term;
+}
+
+struct LatencyStats {
+    double qps = 0.0;
+    double p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0; // milliseconds
+};
+
+static LatencyStats summarize(std::vector<double> latencies, double totalSeconds) {
+    LatencyStats stats;
+    if (latencies.empty()) return stats;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        size_t index = static_cast<size_t>(p * (latencies.size() - 1) + 0.5);
+        return latencies[index] * 1000.0;
+    };
+    stats.qps = latencies.size() / totalSeconds;
+    stats.p50 = percentile(0.50);
+    stats.p90 = percentile(0.90);
+    stats.p99 = percentile(0.99);
+    stats.max = latencies.back() * 1000.0;
+    return stats;
+}
+
+// Flat key -> value results, written in a stable order
+class Report {
+public:
+    void add(const std::string& key, double value) { values[key] = value; }
+
+    void add(const std::string& prefix, const LatencyStats& stats) {
+        add(prefix + "_qps", stats.qps);
+        add(prefix + "_p50_ms", stats.p50);
+        add(prefix + "_p90_ms", stats.p90);
+        add(prefix + "_p99_ms", stats.p99);
+        add(prefix + "_max_ms", stats.max);
+    }
+
+    std::string toJson(const std::map<std::string, std::string>& config) const {
+        std::ostringstream json;
+        json.precision(6);
+        json << "{\n  \"benchmark_version\": 1,\n  \"config\": {";
+        bool first = true;
+        for (const auto& [key, value] : config) {
+            json << (first ? "\n" : ",\n") << "    \"" << key << "\": " << value;
+            first = false;
+        }
+        json << "\n  },\n  \"results\": {";
+        first = true;
+        for (const auto& [key, value] : values) {
+            // JSON has no inf/nan (e.g. a rate over a zero-length timing); those become null
+            json << (first ? "\n" : ",\n") << "    \"" << key << "\": ";
+            if (std::isfinite(value)) json << value;
+            else json << "null";
+            first = false;
+        }
+        json << "\n  }\n}\n";
+        return json.str();
+    }
+
+private:
+    std::map<std::string, double> values;
+};
+
+static uint64_t directoryBytes(const std::string& dir, const std::string& pattern) {
+    uint64_t bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().filename().string().find(pattern) != std::string::npos) {
+            bytes += entry.file_size();
+        }
+    }
+    return bytes;
+}
+
+// -------------------- Microbenchmarks --------------------
+static void benchPreprocessWord(std::mt19937& rng, ZipfSampler& zipf, Report& report) {
+    std::vector<std::wstring> words;
+    for (int i = 0; i < 200000; ++i) {
+        std::wstring word = utf8ToWstring(termForRank(zipf(rng)));
+        if (i % 5 == 0) word[0] = std::towupper(word[0]);
+        if (i % 7 == 0) word += L",";
+        words.push_back(word);
+    }
+
+    size_t checksum = 0;
+    auto start = Clock::now();
+    for (const auto& word : words) checksum += preprocessWord(word).size();
+    double elapsed = secondsSince(start);
+
+    report.add("micro_preprocess_word_ns", elapsed * 1e9 / words.size());
+    report.add("micro_preprocess_word_checksum", static_cast<double>(checksum));
+}
+
+static void benchPositionDecode(std::mt19937& rng, Report& report) {
+    // 20k postings with a handful of increasing positions each
+    const int numPostings = 20000;
+    std::string block;
+    size_t totalPositions = 0;
+    for (int i = 0; i < numPostings; ++i) {
+        std::vector<int> positions;
+        int position = 0;
+        int count = 1 + static_cast<int>(rng() % 6);
+        for (int j = 0; j < count; ++j) {
+            position += 1 + static_cast<int>(rng() % 40);
+            positions.push_back(position);
+        }
+        totalPositions += positions.size();
+        encodePositions(positions, block);
+    }
+
+    const int rounds = 20;
+    size_t checksum = 0;
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        PositionListReader reader(block);
+        for (int i = 0; i < numPostings; ++i) checksum += reader.positionsAt(i).size();
+    }
+    double elapsed = secondsSince(start);
+
+    report.add("micro_position_decode_ns_per_position", elapsed * 1e9 / (totalPositions * rounds));
+    report.add("micro_position_decode_mb_per_s", block.size() * rounds / elapsed / 1e6);
+    report.add("micro_position_decode_checksum", static_cast<double>(checksum));
+}
+
+static void benchPostingsDecode(std::mt19937& rng, ZipfSampler& zipf, Report& report) {
+    // final_index.dat lines as loadIndex reads them: Zipf-sized lists of increasing docIDs
+    const int numTerms = 5000;
+    std::vector<std::string> lines;
+    size_t totalPostings = 0;
+    size_t totalBytes = 0;
+    for (int t = 0; t < numTerms; ++t) {
+        int numPostings = 1 + 20000 / (1 + zipf(rng));
+        std::ostringstream line;
+        line << termForRank(t) << " " << numPostings << " ";
+        int docID = 0;
+        for (int i = 0; i < numPostings; ++i) {
+            docID += 1 + static_cast<int>(rng() % 8);
+            line << docID << " ";
+        }
+        for (int i = 0; i < numPostings; ++i) line << 1 + static_cast<int>(rng() % 5) << " ";
+        lines.push_back(line.str());
+        totalPostings += numPostings;
+        totalBytes += lines.back().size();
+    }
+
+    const int rounds = 5;
+    size_t checksum = 0;
+    std::wstring term;
+    std::vector<Posting> postings;
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (const auto& line : lines) {
+            if (InvertedIndex::parsePostingsLine(line, term, postings)) checksum += postings.size() + postings.back().docID;
+        }
+    }
+    double elapsed = secondsSince(start);
+
+    report.add("micro_postings_decode_ns_per_posting", elapsed * 1e9 / (totalPostings * rounds));
+    report.add("micro_postings_decode_mb_per_s", totalBytes * rounds / elapsed / 1e6);
+    report.add("micro_postings_decode_checksum", static_cast<double>(checksum));
+}
+
+static void benchNextIteration(const InvertedIndex& index, const std::vector<std::wstring>& terms, Report& report) {
+    size_t postings = 0;
+    long long checksum = 0;
+    auto start = Clock::now();
+    for (const auto& term : terms) {
+        index.openList(term);
+        int docID;
+        while ((docID = index.next()) != -1) {
+            checksum += docID + index.getFreq();
+            postings++;
+        }
+        index.closeList();
+    }
+    double elapsed = secondsSince(start);
+
+    report.add("micro_next_ns_per_posting", postings ? elapsed * 1e9 / postings : 0.0);
+    report.add("micro_next_postings", static_cast<double>(postings));
+    report.add("micro_next_checksum", static_cast<double>(checksum));
+}
+
+// -------------------- End-to-end --------------------
+// Connects to a Unix socket server; -1 on failure
+static int connectUnix(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Several clients query one in-process server at once; every response must equal the serial
+// result, so a search path that shares state between worker threads shows up as mismatches.
+// Returns the number of mismatched or failed requests.
+static size_t benchConcurrentClients(const InvertedIndex& index, const std::vector<std::wstring>& queries,
+                                     const std::string& workDir, Report& report) {
+    const int numClients = 8;
+    const std::vector<std::string> modes = {"d", "c", "q"};
+
+    // Expected "results" arrays, serialized the way the server does
+    std::vector<std::string> requests, expected;
+    for (const auto& mode : modes) {
+        for (const auto& query : queries) {
+            std::vector<SearchResult> results = (mode == "q") ? index.searchQuery(query, false)
+                                                              : index.searchWithTFIDF(query, mode == "c");
+            std::ostringstream resultsJson;
+            resultsJson << std::setprecision(9);
+            for (size_t i = 0; i < results.size(); ++i) {
+                resultsJson << (i ? ", " : "") << "{\"docno\": " << index.docno(results[i].docID) << ", \"freq\": "
+                            << results[i].frequency << ", \"score\": " << results[i].tfidf << "}";
+            }
+            expected.push_back("\"results\": [" + resultsJson.str() + "]}");
+            requests.push_back("{\"id\": " + std::to_string(requests.size()) + ", \"q\": \"" + wstringToUtf8(query) +
+                               "\", \"mode\": \"" + mode + "\"}\n");
+        }
+    }
+
+    QueryServerOptions options;
+    options.listen = "unix:" + workDir + "/server.sock";
+    options.workers = 4; // Several workers even on one core, so searches interleave
+    QueryServer server(index, options);
+    if (!server.start()) return requests.size();
+    std::thread runner([&server] { server.run(); });
+
+    // Each client sends every request once, in its own order, and waits for each response
+    std::vector<std::vector<double>> latencies(numClients);
+    std::vector<size_t> failures(numClients, 0);
+    auto start = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < numClients; ++c) {
+        clients.emplace_back([&, c] {
+            int fd = connectUnix(workDir + "/server.sock");
+            if (fd < 0) {
+                failures[c] = requests.size();
+                return;
+            }
+            std::string pending;
+            char buffer[65536];
+            for (size_t n = 0; n < requests.size(); ++n) {
+                size_t r = (n * 7919 + c * 104729) % requests.size(); // Distinct stride per client
+                auto requestStart = Clock::now();
+                if (send(fd, requests[r].data(), requests[r].size(), MSG_NOSIGNAL) != static_cast<ssize_t>(requests[r].size())) {
+                    failures[c] += requests.size() - n;
+                    break;
+                }
+                size_t newline;
+                while ((newline = pending.find('\n')) == std::string::npos) {
+                    ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+                    if (got <= 0) break;
+                    pending.append(buffer, got);
+                }
+                if (newline == std::string::npos) {
+                    failures[c] += requests.size() - n;
+                    break;
+                }
+                latencies[c].push_back(secondsSince(requestStart));
+
+                std::string response = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                bool ok = response.rfind("{\"id\": " + std::to_string(r) + ", \"status\": \"ok\"", 0) == 0 &&
+                          response.size() >= expected[r].size() &&
+                          response.compare(response.size() - expected[r].size(), std::string::npos, expected[r]) == 0;
+                if (!ok) failures[c]++;
+            }
+            close(fd);
+        });
+    }
+    for (auto& client : clients) client.join();
+    double totalSeconds = secondsSince(start);
+
+    QueryServer::requestStop();
+    runner.join();
+
+    std::vector<double> allLatencies;
+    for (const auto& clientLatencies : latencies) allLatencies.insert(allLatencies.end(), clientLatencies.begin(), clientLatencies.end());
+    size_t mismatches = std::accumulate(failures.begin(), failures.end(), size_t{0});
+    report.add("server_concurrent", summarize(allLatencies, totalSeconds));
+    report.add("server_concurrent_clients", numClients);
+    report.add("server_concurrent_mismatches", static_cast<double>(mismatches));
+    return mismatches;
+}
+
+static std::vector<double> replay(const std::vector<std::wstring>& queries, Report& report, const std::string& name,
+                                  const std::function<void(const std::wstring&)>& run) {
+    std::vector<double> latencies;
+    auto start = Clock::now();
+    for (const auto& query : queries) {
+        auto queryStart = Clock::now();
+        run(query);
+        latencies.push_back(secondsSince(queryStart));
+    }
+    report.add(name, summarize(latencies, secondsSince(start)));
+    return latencies;
+}
+
+int main(int argc, char* argv[]) {
+    int numDocs = 20000;
+    int numQueries = 500;
+    int vocabularySize = 50000;
+    unsigned seed = 42;
+    std::string workDir = "benchmark_work";
+    std::string outPath;
+    int pruneK = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--docs") numDocs = std::stoi(argv[i + 1]);
+        else if (flag == "--queries") numQueries = std::stoi(argv[i + 1]);
+        else if (flag == "--vocabulary") vocabularySize = std::stoi(argv[i + 1]);
+        else if (flag == "--seed") seed = static_cast<unsigned>(std::stoul(argv[i + 1]));
+        else if (flag == "--work-dir") workDir = argv[i + 1];
+        else if (flag == "--out") outPath = argv[i + 1];
+        else if (flag == "--prune") pruneK = std::stoi(argv[i + 1]);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [--docs N] [--queries N] [--vocabulary N] [--seed N] [--work-dir DIR] [--out FILE] [--prune K]" << std::endl;
+            return 1;
+        }
+    }
+
+    Report report;
+    std::mt19937 rng(seed);
+    ZipfSampler zipf(vocabularySize, 1.0);
+
+    std::filesystem::remove_all(workDir);
+    std::string indexPath = workDir + "/index";
+    std::filesystem::create_directories(indexPath);
+
+    // Corpus: one "<pid>\t<text>" line per document, 20-80 Zipf-distributed terms each
+    std::string corpusPath = workDir + "/corpus.tsv";
+    {
+        std::ofstream corpus(corpusPath);
+        for (int docID = 0; docID < numDocs; ++docID) {
+            int length = 20 + static_cast<int>(rng() % 61);
+            corpus << docID << "\t";
+            for (int i = 0; i < length; ++i) corpus << (i ? " " : "") << termForRank(zipf(rng));
+            corpus << "\n";
+        }
+    }
+    uint64_t corpusBytes = std::filesystem::file_size(corpusPath);
+
+    // Queries: 2-3 terms drawn from the Zipf distribution, skipping the very top stopword-like ranks
+    std::vector<std::wstring> queries;
+    for (int i = 0; i < numQueries; ++i) {
+        int length = 2 + static_cast<int>(rng() % 2);
+        std::wstring query;
+        for (int j = 0; j < length; ++j) {
+            int rank = zipf(rng);
+            if (rank < 10) rank += 10;
+            query += (j ? L" " : L"") + utf8ToWstring(termForRank(rank));
+        }
+        queries.push_back(query);
+    }
+
+    std::cerr << "Running microbenchmarks..." << std::endl;
+    benchPreprocessWord(rng, zipf, report);
+    benchPositionDecode(rng, report);
+    benchPostingsDecode(rng, zipf, report);
+
+    std::cerr << "Indexing " << numDocs << " synthetic documents..." << std::endl;
+    {
+        MuteOutput mute;
+
+        auto start = Clock::now();
+        DocumentParser parser(corpusPath, -1);
+        parser.parseDocuments();
+        double parseSeconds = secondsSince(start);
+        report.add("parse_seconds", parseSeconds);
+        report.add("parse_docs_per_s", numDocs / parseSeconds);
+        report.add("parse_mb_per_s", corpusBytes / parseSeconds / 1e6);
+
+        InvertedIndex builder;
+        start = Clock::now();
+        builder.buildIndexSPIMI(parser.getDocuments(), InvertedIndex::estimateChunkSize(), indexPath);
+        double buildSeconds = secondsSince(start);
+        report.add("spimi_seconds", buildSeconds);
+        report.add("spimi_docs_per_s", numDocs / buildSeconds);
+
+        int numChunks = InvertedIndex::countChunks(indexPath);
+        uint64_t chunkBytes = directoryBytes(indexPath, "_chunk_");
+        start = Clock::now();
+        builder.mergeIndexes(numChunks, indexPath);
+        double mergeSeconds = secondsSince(start);
+        report.add("merge_chunks", numChunks);
+        report.add("merge_seconds", mergeSeconds);
+        report.add("merge_input_mb_per_s", chunkBytes / mergeSeconds / 1e6);
+        report.add("index_bytes", static_cast<double>(directoryBytes(indexPath, "final_")));
+        InvertedIndex::writeSegments(indexPath, {}, numDocs);
+
+        if (pruneK > 0) {
+            PruningStats pruning;
+            start = Clock::now();
+            buildTier1(indexPath, pruneK, pruning);
+            report.add("tier1_build_seconds", secondsSince(start));
+            report.add("tier1_postings_fraction", pruning.fullPostings ? static_cast<double>(pruning.tier1Postings) / pruning.fullPostings : 0.0);
+        }
+    }
+
+    InvertedIndex index;
+    {
+        MuteOutput mute;
+        auto start = Clock::now();
+        index.loadIndex(indexPath);
+        report.add("load_seconds", secondsSince(start));
+    }
+
+    std::cerr << "Replaying " << queries.size() << " queries..." << std::endl;
+    size_t serverMismatches = 0;
+    {
+        MuteOutput mute;
+
+        // Iterator throughput over the lists of every distinct query term
+        std::vector<std::wstring> queryTerms;
+        std::unordered_set<std::wstring> seenTerms;
+        for (const auto& query : queries) {
+            std::wstringstream wss(query);
+            std::wstring term;
+            while (wss >> term) {
+                if (seenTerms.insert(term).second) queryTerms.push_back(term);
+            }
+        }
+        benchNextIteration(index, queryTerms, report);
+
+        // The baseline always scans the full lists, so its numbers do not depend on --prune
+        index.setTierMode(TierMode::Off);
+        replay(queries, report, "query_and", [&](const std::wstring& q) { index.searchWithTFIDF(q, true); });
+        replay(queries, report, "query_or", [&](const std::wstring& q) { index.searchWithTFIDF(q, false); });
+        replay(queries, report, "cursor_and", [&](const std::wstring& q) { index.searchQuery(q, true); });
+        replay(queries, report, "cursor_or", [&](const std::wstring& q) { index.searchQuery(q, false); });
+
+        serverMismatches = benchConcurrentClients(index, queries, workDir, report);
+
+        if (pruneK > 0) {
+            // Safe mode returns the exact top 20; its gain depends on how often tier 1 suffices
+            index.setTierMode(TierMode::Safe);
+            TierStats before = index.tierStats();
+            replay(queries, report, "tier_safe_or", [&](const std::wstring& q) { index.searchWithTFIDF(q, false); });
+            TierStats after = index.tierStats();
+            uint64_t served = after.served - before.served;
+            uint64_t total = served + after.fallbacks - before.fallbacks;
+            report.add("tier_safe_hit_rate", total ? static_cast<double>(served) / total : 0.0);
+
+            // Unsafe mode never falls back; quality is the share of the exact top 20 it still finds
+            index.setTierMode(TierMode::Unsafe);
+            replay(queries, report, "tier_unsafe_or", [&](const std::wstring& q) { index.searchWithTFIDF(q, false); });
+
+            double overlapSum = 0.0;
+            for (const auto& query : queries) {
+                index.setTierMode(TierMode::Off);
+                std::vector<SearchResult> exact = index.searchWithTFIDF(query, false);
+                index.setTierMode(TierMode::Unsafe);
+                std::vector<SearchResult> pruned = index.searchWithTFIDF(query, false);
+
+                std::unordered_set<int> found;
+                for (const auto& result : pruned) found.insert(result.docID);
+                size_t hits = 0;
+                for (const auto& result : exact) hits += found.count(result.docID);
+                overlapSum += exact.empty() ? 1.0 : static_cast<double>(hits) / exact.size();
+            }
+            report.add("tier_unsafe_overlap_at_20", queries.empty() ? 0.0 : overlapSum / queries.size());
+        }
+    }
+
+    std::map<std::string, std::string> config = {
+        {"docs", std::to_string(numDocs)},
+        {"queries", std::to_string(numQueries)},
+        {"vocabulary", std::to_string(vocabularySize)},
+        {"zipf_exponent", "1.0"},
+        {"seed", std::to_string(seed)},
+        {"prune", std::to_string(pruneK)},
+    };
+    std::string json = report.toJson(config);
+
+    if (outPath.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(outPath) << json;
+        std::cerr << "Results written to " << outPath << std::endl;
+    }
+
+    if (serverMismatches > 0) {
+        std::cerr << " ERROR: " << serverMismatches << " concurrent server responses differ from the serial results" << std::endl;
+        return 1;
+    }
+    return 0;
+}
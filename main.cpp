@@ -1,27 +1,53 @@
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 #include <filesystem>  // For directory handling
+#include <thread>
 #include "DocumentParser.h"
 #include "InvertedIndex.h"
+#include "IndexManifest.h"
+#include "DocIDReorder.h"
+#include "StaticPruning.h"
 #include "QueryProcessor.h"
+#include "QueryServer.h"
+#include "ShardCoordinator.h"
+#include "utils.h"
 
-int main(int argc, char* argv[]) {
-    if (argc < 2 || argc > 3) {
-        std::cerr << "Usage: " << argv[0] << " <dataset_path> [num_docs]" << std::endl;
-        return 1;
-    }
-
-    std::string datasetPath = argv[1];
-    int numDocs = (argc == 3) ? std::stoi(argv[2]) : -1;
-    std::string indexPath = "/home/sultan/MIRCV_Project/main/index_files";
-
-    std::cout << " Using dataset path: " << datasetPath << std::endl;
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " index <dataset_path> <index_dir> [num_docs] [--positions] [--reorder] [--shards N] [--prune K]" << std::endl;
+    std::cerr << "       " << program << " serve <index_dir> [--explain] [--tiers off|safe|unsafe]" << std::endl;
+    std::cerr << "       " << program << " serve <index_dir> --listen unix:<path>|tcp:<port> [--workers N] [--deadline-ms MS] [--tiers off|safe|unsafe]" << std::endl;
+    std::cerr << "       " << program << " reorder <index_dir>" << std::endl;
+    std::cerr << "       " << program << " append <batch_path> <index_dir> [num_docs]" << std::endl;
+    std::cerr << "       " << program << " delete <docno> <index_dir>" << std::endl;
+    std::cerr << "       " << program << " update <docno> <text> <index_dir>" << std::endl;
+    std::cerr << "       " << program << " <dataset_path> [num_docs]   (index into ./index_files, then serve)" << std::endl;
+}
 
-    //  Parse documents
-    DocumentParser parser(datasetPath, numDocs);
-    parser.parseDocuments();
+// Parses a whole decimal integer in [minValue, maxValue]; prints an error naming what it is otherwise
+static bool parseInt(const std::string& text, const std::string& name, long minValue, long maxValue, int& value) {
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno == ERANGE || parsed < minValue || parsed > maxValue) {
+        std::cerr << " ERROR: " << name << " must be an integer in [" << minValue << ", " << maxValue
+                  << "], got \"" << text << "\"" << std::endl;
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
 
+// Builds a fresh index of already parsed documents, with its manifest; nextDocID is where appends
+// continue, and pruneK > 0 adds a tier 1 of the top pruneK postings per term
+static bool buildFromDocuments(const std::unordered_map<int, std::wstring>& documents, const std::string& indexPath,
+                               int nextDocID, bool positions, bool reorder, int pruneK) {
     //  Initialize Inverted Index
     InvertedIndex index;
+    index.setPositional(positions);
     int chunkSize = index.estimateChunkSize();
     std::cout << " Estimated Chunk Size: " << chunkSize << std::endl;
 
@@ -30,36 +56,361 @@ int main(int argc, char* argv[]) {
         std::filesystem::create_directories(indexPath);
     }
 
+    //  A stale manifest must not validate a half-built index, and stale chunks or shards must not be merged
+    std::filesystem::remove(indexPath + "/manifest.dat");
+    std::filesystem::remove(indexPath + "/global_stats.dat");
+    std::filesystem::remove(indexPath + "/tier1_index.dat");
+    std::filesystem::remove(indexPath + "/tier1_cutoffs.dat");
+    for (const auto& entry : std::filesystem::directory_iterator(indexPath)) {
+        std::string name = entry.path().filename().string();
+        if (name.find("_chunk_") != std::string::npos || name.rfind("shard_", 0) == 0) {
+            std::filesystem::remove_all(entry.path());
+        }
+    }
+
     //  Build SPIMI Index
     std::cout << " Building Index using SPIMI..." << std::endl;
-    index.buildIndexSPIMI(parser.getDocuments(), chunkSize, indexPath);
+    index.buildIndexSPIMI(documents, chunkSize, indexPath);
 
     //  Automatically detect number of chunk files for merging
-    int numChunks = 0;
-    for (const auto& entry : std::filesystem::directory_iterator(indexPath)) {
-        if (entry.path().string().find("index_chunk_") != std::string::npos) {
-            numChunks++;
-        }
-    }
+    int numChunks = InvertedIndex::countChunks(indexPath);
 
     if (numChunks == 0) {
         std::cerr << " ERROR: No index chunks found. Index merging cannot proceed." << std::endl;
-        return 1;
+        return false;
     }
 
     std::cout << " Merging " << numChunks << " index chunks into final index..." << std::endl;
     index.mergeIndexes(numChunks, indexPath);
 
+    //  A full rebuild supersedes any delta segments from earlier appends
+    int previousNextDocID = 0;
+    for (const auto& segment : InvertedIndex::readSegments(indexPath, previousNextDocID)) {
+        std::filesystem::remove_all(indexPath + "/" + segment.name);
+    }
+    InvertedIndex::writeSegments(indexPath, {}, nextDocID);
+
+    //  DocIDs were reassigned, so old tombstones no longer apply
+    std::filesystem::remove(indexPath + "/deleted_docs.dat");
+
+    //  Optional: cluster similar documents into nearby docIDs for smaller d-gaps
+    ReorderStats reorderStats;
+    if (reorder && !reorderDocIDs(indexPath, reorderStats)) return false;
+
+    //  Optional: pruned first tier over the final docIDs
+    PruningStats pruningStats;
+    if (pruneK > 0 && !buildTier1(indexPath, pruneK, pruningStats)) return false;
+
+    //  Written last: its presence marks the index as complete
+    IndexManifest manifest = IndexManifest::forCurrentBuild(static_cast<int>(documents.size()));
+    manifest.positions = positions;
+    manifest.tier1Postings = pruneK;
+    return manifest.save(indexPath);
+}
+
+// Parses the corpus and builds a fresh index, or numShards docID-partitioned shard indexes
+static bool buildIndex(const std::string& datasetPath, const std::string& indexPath, int numDocs, bool positions, bool reorder,
+                       int numShards, int pruneK) {
+    std::cout << " Using dataset path: " << datasetPath << std::endl;
+
+    //  Parse documents
+    DocumentParser parser(datasetPath, numDocs);
+    parser.parseDocuments();
+    const auto& documents = parser.getDocuments();
+    int numParsed = static_cast<int>(documents.size());
+
+    if (numShards <= 0) {
+        return buildFromDocuments(documents, indexPath, numParsed, positions, reorder, pruneK);
+    }
+
+    //  Shards are complete indexes of contiguous docID ranges, built in parallel
+    if (!std::filesystem::exists(indexPath)) {
+        std::filesystem::create_directories(indexPath);
+    }
+    std::filesystem::remove(indexPath + "/manifest.dat");
+    for (const auto& entry : std::filesystem::directory_iterator(indexPath)) {
+        if (entry.path().filename().string().rfind("shard_", 0) == 0) {
+            std::filesystem::remove_all(entry.path());
+        }
+    }
+
+    auto partitions = ShardCoordinator::partitionDocuments(documents, numShards);
+    std::vector<char> built(numShards, 0);
+    std::vector<std::thread> builders;
+    for (int i = 0; i < numShards; ++i) {
+        builders.emplace_back([&, i]() {
+            std::string shardPath = ShardCoordinator::shardPath(indexPath, i);
+            std::filesystem::create_directories(shardPath);
+            built[i] = buildFromDocuments(partitions[i], shardPath, numParsed, positions, false, pruneK);
+        });
+    }
+    for (auto& builder : builders) builder.join();
+
+    for (int i = 0; i < numShards; ++i) {
+        if (!built[i]) {
+            std::cerr << " ERROR: Building shard " << i << " failed." << std::endl;
+            return false;
+        }
+    }
+
+    //  N and df over the whole collection keep IDF identical to a single index
+    if (!ShardCoordinator::writeGlobalStats(indexPath, numShards)) return false;
+
+    IndexManifest manifest = IndexManifest::forCurrentBuild(numParsed);
+    manifest.positions = positions;
+    manifest.shards = numShards;
+    manifest.tier1Postings = pruneK;
+    return manifest.save(indexPath);
+}
+
+// Checks that indexPath holds a complete index this binary can use
+static bool validateIndex(const std::string& indexPath, IndexManifest& manifest) {
+    if (!manifest.load(indexPath)) {
+        std::cerr << " ERROR: No index manifest in " << indexPath << ", build it first with the index command." << std::endl;
+        return false;
+    }
+
+    std::string error;
+    if (!manifest.isCompatible(error)) {
+        std::cerr << " ERROR: Incompatible index in " << indexPath << ": " << error << std::endl;
+        return false;
+    }
+
+    std::cout << " Opening index " << indexPath << " (format " << manifest.formatVersion
+              << ", " << manifest.numDocs << " documents"
+              << (manifest.shards > 0 ? ", " + std::to_string(manifest.shards) + " shards" : "") << ")" << std::endl;
+    return true;
+}
+
+// Validates an index that is about to be modified in place; shards only support full rebuilds
+static bool validateSingleIndex(const std::string& indexPath) {
+    IndexManifest manifest;
+    if (!validateIndex(indexPath, manifest)) return false;
+    if (manifest.shards > 0) {
+        std::cerr << " ERROR: " << indexPath << " is a sharded index, rebuild it with the index command instead." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void printTierStats(const IndexManifest& manifest, TierMode mode, const TierStats& stats) {
+    if (manifest.tier1Postings <= 0 || mode == TierMode::Off) return;
+    uint64_t total = stats.served + stats.fallbacks;
+    std::cout << " Tier 1 answered " << stats.served << " of " << total << " ranked queries ("
+              << (total ? 100.0 * stats.served / total : 0.0) << "%)" << std::endl;
+}
+
+// SIGINT/SIGTERM stop the query daemon
+static void handleStopSignal(int) {
+    QueryServer::requestStop();
+}
+
+// Runs the query daemon until SIGINT/SIGTERM
+template <typename Searcher>
+static void runServer(const Searcher& searcher, const QueryServerOptions& serverOptions) {
+    QueryServer server(searcher, serverOptions);
+    if (!server.start()) return;
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+    server.run();
+}
+
+// Loads an existing index and answers queries interactively, or as a daemon when serverOptions.listen is set
+static bool serveIndex(const std::string& indexPath, bool explain, TierMode tierMode,
+                       const QueryServerOptions& serverOptions) {
+    IndexManifest manifest;
+    if (!validateIndex(indexPath, manifest)) return false;
+    bool daemon = !serverOptions.listen.empty();
+
+    if (manifest.shards > 0) {
+        ShardCoordinator coordinator;
+        std::cout << " Loading " << manifest.shards << " shards from disk..." << std::endl;
+        if (!coordinator.open(indexPath, manifest.shards)) return false;
+        coordinator.setTierMode(tierMode);
+        std::cout << " Index loaded successfully!" << std::endl;
+
+        if (daemon) {
+            runServer(coordinator, serverOptions);
+        } else {
+            QueryProcessor qp(coordinator, explain);
+            std::cout << " Starting query processing..." << std::endl;
+            qp.processQueries();
+            std::cout << " Finished query processing." << std::endl;
+        }
+        printTierStats(manifest, tierMode, coordinator.tierStats());
+        return true;
+    }
+
+    InvertedIndex index;
+
     //  Load the final merged index
     std::cout << " Loading index from disk..." << std::endl;
-    index.loadIndex(indexPath);
+    if (!index.loadIndex(indexPath)) return false;
+    index.setTierMode(tierMode);
     std::cout << " Index loaded successfully!" << std::endl;
 
+    if (daemon) {
+        //  Per-query console output would serialize the workers on std::wcout
+        index.setVerbose(false);
+        runServer(index, serverOptions);
+        printTierStats(manifest, tierMode, index.tierStats());
+        return true;
+    }
+
     //  Start Query Processing
-    QueryProcessor qp(index);
+    QueryProcessor qp(index, explain);
     std::cout << " Starting query processing..." << std::endl;
     qp.processQueries();
     std::cout << " Finished query processing." << std::endl;
+    printTierStats(manifest, tierMode, index.tierStats());
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string mode = argv[1];
+
+    if (mode == "index" && argc >= 4 && argc <= 11) {
+        int numDocs = -1;
+        bool positions = false;
+        bool reorder = false;
+        int numShards = 0;
+        int pruneK = 0;
+        for (int i = 4; i < argc; ++i) {
+            std::string option = argv[i];
+            bool valid = true;
+            if (option == "--positions") positions = true;
+            else if (option == "--reorder") reorder = true;
+            else if (option == "--shards" && i + 1 < argc) valid = parseInt(argv[++i], "--shards", 1, 1024, numShards);
+            else if (option == "--prune" && i + 1 < argc) valid = parseInt(argv[++i], "--prune", 1, INT_MAX, pruneK);
+            else if (option.rfind("--", 0) != 0) valid = parseInt(option, "num_docs", 1, INT_MAX, numDocs);
+            else valid = false; // Unknown option, or one missing its value
+            if (!valid) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        if (reorder && numShards > 0) {
+            std::cerr << " ERROR: --reorder cannot be combined with --shards (shards own fixed docID ranges)." << std::endl;
+            return 1;
+        }
+        return buildIndex(argv[2], argv[3], numDocs, positions, reorder, numShards, pruneK) ? 0 : 1;
+    }
+
+    if (mode == "reorder" && argc == 3) {
+        if (!validateSingleIndex(argv[2])) return 1;
+        ReorderStats stats;
+        if (!reorderDocIDs(argv[2], stats)) return 1;
+
+        //  Tier 1 names docIDs, so it is rebuilt from the renumbered lists
+        IndexManifest manifest;
+        manifest.load(argv[2]);
+        PruningStats pruningStats;
+        return (manifest.tier1Postings <= 0 || buildTier1(argv[2], manifest.tier1Postings, pruningStats)) ? 0 : 1;
+    }
+
+    if ((mode == "serve" || mode == "query") && argc >= 3 && argc <= 12) {
+        bool explain = false;
+        TierMode tierMode = TierMode::Safe;
+        QueryServerOptions serverOptions;
+        for (int i = 3; i < argc; ++i) {
+            std::string option = argv[i];
+            std::string value = (i + 1 < argc) ? argv[i + 1] : "";
+            if (option == "--explain") {
+                explain = true;
+            } else if (option == "--tiers" && (value == "off" || value == "safe" || value == "unsafe")) {
+                tierMode = (value == "off") ? TierMode::Off : (value == "safe") ? TierMode::Safe : TierMode::Unsafe;
+                ++i;
+            } else if (option == "--listen" && !value.empty()) {
+                serverOptions.listen = value;
+                ++i;
+            } else if (option == "--workers" && !value.empty() && parseInt(value, "--workers", 0, 1024, serverOptions.workers)) {
+                ++i;
+            } else if (option == "--deadline-ms" && !value.empty() &&
+                       parseInt(value, "--deadline-ms", 0, 3600000, serverOptions.defaultDeadlineMs)) {
+                ++i;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+        if (explain && !serverOptions.listen.empty()) {
+            std::cerr << " ERROR: --explain only applies to interactive serving; use the \":metrics\" request instead." << std::endl;
+            return 1;
+        }
+        return serveIndex(argv[2], explain, tierMode, serverOptions) ? 0 : 1;
+    }
+
+    if (mode == "append" && (argc == 4 || argc == 5)) {
+        std::string datasetPath = argv[2];
+        std::string indexPath = argv[3];
+        int numDocs = -1;
+        if (argc == 5 && !parseInt(argv[4], "num_docs", 1, INT_MAX, numDocs)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (!validateSingleIndex(indexPath)) return 1;
+
+        //  New docIDs continue after the current index and its segments
+        int nextDocID = 0;
+        InvertedIndex::readSegments(indexPath, nextDocID);
+
+        std::cout << " Using dataset path: " << datasetPath << std::endl;
+        DocumentParser parser(datasetPath, numDocs, nextDocID);
+        parser.parseDocuments();
+
+        std::cout << " Appending batch starting at docID " << nextDocID << "..." << std::endl;
+        InvertedIndex index;
+        return index.appendSegment(parser.getDocuments(), indexPath) ? 0 : 1;
+    }
+
+    if (mode == "delete" && argc == 4) {
+        //  Tombstone first; segment postings go at the next segment merge, main-index postings
+        //  once enough of the main index is deleted
+        int docno;
+        if (!parseInt(argv[2], "docno", 0, INT_MAX, docno)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (!validateSingleIndex(argv[3])) return 1;
+        InvertedIndex index;
+        return index.deleteDocument(docno, argv[3]) ? 0 : 1;
+    }
+
+    if (mode == "update" && argc == 5) {
+        int docno;
+        if (!parseInt(argv[2], "docno", 0, INT_MAX, docno)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::wstring text;
+        try {
+            text = utf8ToWstring(argv[3]);
+        } catch (const std::range_error&) {
+            std::cerr << " ERROR: The document text is not valid UTF-8." << std::endl;
+            return 1;
+        }
+        if (!validateSingleIndex(argv[4])) return 1;
+        InvertedIndex index;
+        return index.updateDocument(docno, text, argv[4]) ? 0 : 1;
+    }
+
+    //  Original invocation: build into ./index_files, then serve it
+    if (argc == 2 || argc == 3) {
+        std::string indexPath = "index_files";
+        int numDocs = -1;
+        if (argc == 3 && !parseInt(argv[2], "num_docs", 1, INT_MAX, numDocs)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (!buildIndex(argv[1], indexPath, numDocs, false, false, 0, 0)) return 1;
+        return serveIndex(indexPath, false, TierMode::Safe, QueryServerOptions()) ? 0 : 1;
+    }
 
-    return 0;
+    printUsage(argv[0]);
+    return 1;
 }
@@ -0,0 +1,425 @@
+// Correctness checks for the on-disk formats and the query paths. Each check builds small indexes
+// in a scratch directory and compares them with a fresh build of the same live documents or with
+// known answers. Failures are printed; the exit status is 1 if any check failed.
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <map>
+#include <set>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "InvertedIndex.h"
+#include "IndexManifest.h"
+#include "DeletedDocs.h"
+#include "PositionalIndex.h"
+#include "QueryParser.h"
+#include "utils.h"
+
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << " FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Index building and loading report progress on stdout; checks only need their own output
+struct MuteOutput {
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    std::wstreambuf* wout = std::wcout.rdbuf(nullptr);
+    ~MuteOutput() {
+        std::cout.rdbuf(out);
+        std::wcout.rdbuf(wout);
+        std::cout.clear();
+        std::wcout.clear();
+    }
+};
+
+// Rejections that a check expects also print an error; keeps them out of the report
+struct MuteErrors {
+    std::streambuf* err = std::cerr.rdbuf(nullptr);
+    ~MuteErrors() {
+        std::cerr.rdbuf(err);
+        std::cerr.clear();
+    }
+};
+
+// -------------------- Helpers --------------------
+// Skewed vocabulary of letter-only words, so preprocessing leaves them untouched
+static std::vector<std::wstring> makeVocabulary(int size) {
+    std::vector<std::wstring> vocabulary;
+    for (int rank = 0; rank < size; ++rank) {
+        std::wstring word = L"w";
+        int value = rank;
+        do {
+            word += static_cast<wchar_t>(L'a' + value % 26);
+            value /= 26;
+        } while (value > 0);
+        vocabulary.push_back(word);
+    }
+    return vocabulary;
+}
+
+static std::wstring randomText(std::mt19937& rng, const std::vector<std::wstring>& vocabulary) {
+    int length = 5 + static_cast<int>(rng() % 26);
+    std::wstring text;
+    for (int i = 0; i < length; ++i) {
+        size_t rank = std::min(rng() % vocabulary.size(), rng() % vocabulary.size());
+        text += (i ? L" " : L"") + vocabulary[rank];
+    }
+    return text;
+}
+
+// Builds a complete single index (chunks, merge, segments.dat, manifest) of documents keyed by docID
+static void buildIndex(const std::unordered_map<int, std::wstring>& documents, const std::string& path,
+                       bool positional, int nextDocID) {
+    MuteOutput mute;
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+
+    InvertedIndex builder;
+    builder.setPositional(positional);
+    builder.buildIndexSPIMI(documents, InvertedIndex::estimateChunkSize(), path);
+    builder.mergeIndexes(InvertedIndex::countChunks(path), path);
+    InvertedIndex::writeSegments(path, {}, nextDocID);
+
+    IndexManifest manifest = IndexManifest::forCurrentBuild(static_cast<int>(documents.size()));
+    manifest.positions = positional;
+    manifest.save(path);
+}
+
+// term -> docno -> (freq, score) of every live posting, as seen through the public search API
+using IndexSnapshot = std::map<std::wstring, std::map<int, std::pair<int, double>>>;
+
+static IndexSnapshot snapshot(const std::string& path, const std::vector<std::wstring>& vocabulary) {
+    MuteOutput mute;
+    InvertedIndex index;
+    index.setVerbose(false);
+    IndexSnapshot result;
+    check(index.loadIndex(path), "load of " + path);
+
+    for (const auto& term : vocabulary) {
+        index.openList(term);
+        int docID;
+        while ((docID = index.next()) != -1) result[term][index.docno(docID)] = {index.getFreq(), 0.0};
+        index.closeList();
+
+        for (const auto& hit : index.searchQuery(term, false, 1000000)) result[term][index.docno(hit.docID)].second = hit.tfidf;
+    }
+    return result;
+}
+
+static bool sameSnapshot(const IndexSnapshot& a, const IndexSnapshot& b) {
+    if (a.size() != b.size()) return false;
+    for (const auto& [term, postings] : a) {
+        auto other = b.find(term);
+        if (other == b.end() || other->second.size() != postings.size()) return false;
+        for (const auto& [docno, entry] : postings) {
+            auto match = other->second.find(docno);
+            if (match == other->second.end() || match->second.first != entry.first ||
+                std::abs(match->second.second - entry.second) > 1e-9) return false;
+        }
+    }
+    return true;
+}
+
+// -------------------- Delta segments --------------------
+// Appending batches (and merging the segments they form) must give the same live postings and
+// scores as indexing every document at once
+static void testAppendAndMerge(const std::string& workDir) {
+    std::mt19937 rng(7);
+    std::vector<std::wstring> vocabulary = makeVocabulary(80);
+    std::unordered_map<int, std::wstring> all;
+    for (int docID = 0; docID < 1400; ++docID) all[docID] = randomText(rng, vocabulary);
+
+    std::unordered_map<int, std::wstring> main;
+    for (int docID = 0; docID < 1200; ++docID) main[docID] = all[docID];
+    std::string path = workDir + "/segments";
+    buildIndex(main, path, true, 1200);
+
+    int nextDocID = 0;
+    for (int batch = 0; batch < 4; ++batch) {
+        std::unordered_map<int, std::wstring> documents;
+        for (int docID = 1200 + batch * 50; docID < 1250 + batch * 50; ++docID) documents[docID] = all[docID];
+        MuteOutput mute;
+        InvertedIndex index;
+        check(index.appendSegment(documents, path), "append of batch " + std::to_string(batch));
+    }
+    check(InvertedIndex::readSegments(path, nextDocID).size() == 1, "four same-tier segments are merged into one");
+    check(nextDocID == 1400, "next docID continues after the appended batches");
+
+    std::string fullPath = workDir + "/segments_full";
+    buildIndex(all, fullPath, true, 1400);
+    IndexSnapshot appended = snapshot(path, vocabulary);
+    check(appended.size() == vocabulary.size(), "every term of the appended index is searchable");
+    check(sameSnapshot(appended, snapshot(fullPath, vocabulary)), "appended and merged segments match a full build");
+}
+
+// -------------------- Deletions and updates --------------------
+static void testDeletedDocsFile(const std::string& workDir) {
+    std::string path = workDir + "/tombstones";
+    std::filesystem::create_directories(path);
+
+    DeletedDocs empty;
+    check(empty.load(path) && empty.empty(), "a missing tombstone file means nothing is deleted");
+
+    DeletedDocs deleted;
+    for (int docID : {1000, 0, 63, 64}) deleted.markDeleted(docID);
+    check(!deleted.markDeleted(63), "marking a deleted docID again reports it");
+    check(!deleted.markDeleted(-1), "negative docIDs are rejected");
+    check(deleted.save(path), "tombstone save");
+
+    DeletedDocs loaded;
+    check(loaded.load(path), "tombstone load");
+    check(loaded.count() == 4 && loaded.deletedIDs() == std::vector<int>({0, 63, 64, 1000}),
+          "tombstones survive a save/load round-trip");
+    check(loaded.isDeleted(64) && !loaded.isDeleted(65) && !loaded.isDeleted(100000),
+          "isDeleted after a round-trip");
+
+    // A header that claims more words than the file holds must not allocate them
+    {
+        std::ofstream file(path + "/deleted_docs.dat", std::ios::binary | std::ios::trunc);
+        uint64_t numWords = uint64_t(1) << 40;
+        file.write(reinterpret_cast<const char*>(&numWords), sizeof(numWords));
+    }
+    MuteErrors mute;
+    check(!loaded.load(path) && loaded.empty(), "a corrupt tombstone file is rejected");
+}
+
+// Documents in the main index's doc-length table, which a purge rewrites
+static size_t countMainDocs(const std::string& path) {
+    std::ifstream docLengthsFile(path + "/final_doclengths.dat");
+    size_t numDocs = 0;
+    int docID, docLength;
+    while (docLengthsFile >> docID >> docLength) numDocs++;
+    return numDocs;
+}
+
+// Deleting and updating documents (in the main index and in a segment, enough to purge the main
+// index) must leave the same live documents, by docno, as a fresh build of what is left
+static void testDeleteAndUpdate(const std::string& workDir) {
+    std::mt19937 rng(11);
+    std::vector<std::wstring> vocabulary = makeVocabulary(80);
+    std::map<int, std::wstring> live;
+    for (int docno = 0; docno < 1300; ++docno) live[docno] = randomText(rng, vocabulary);
+
+    std::unordered_map<int, std::wstring> main, appended;
+    for (const auto& [docno, text] : live) (docno < 1200 ? main : appended)[docno] = text;
+    std::string path = workDir + "/deletions";
+    buildIndex(main, path, true, 1200);
+    {
+        MuteOutput mute;
+        InvertedIndex index;
+        check(index.appendSegment(appended, path), "append before deletions");
+    }
+
+    auto compareWithFreshBuild = [&](const std::string& what) {
+        std::unordered_map<int, std::wstring> documents(live.begin(), live.end());
+        std::string freshPath = workDir + "/deletions_fresh";
+        buildIndex(documents, freshPath, true, live.rbegin()->first + 1);
+        check(sameSnapshot(snapshot(path, vocabulary), snapshot(freshPath, vocabulary)), what);
+
+        IndexManifest manifest;
+        check(manifest.load(path) && manifest.numDocs == static_cast<int>(live.size()),
+              what + ": manifest counts the live documents");
+    };
+
+    {
+        MuteOutput mute;
+        InvertedIndex index;
+        for (int docno : {3, 500, 1250}) {
+            check(index.deleteDocument(docno, path), "delete of docno " + std::to_string(docno));
+            live.erase(docno);
+        }
+        for (int docno : {10, 1210}) {
+            live[docno] = randomText(rng, vocabulary);
+            check(index.updateDocument(docno, live[docno], path), "update of docno " + std::to_string(docno));
+        }
+        MuteErrors muteErrors;
+        check(!index.deleteDocument(500, path), "deleting a deleted docno fails");
+    }
+    compareWithFreshBuild("deletes and updates match a fresh build");
+
+    size_t mainDocs = countMainDocs(path);
+    {
+        MuteOutput mute;
+        InvertedIndex index;
+        for (int docno = 600; docno < 600 + 0.25 * 1200; ++docno) {
+            index.deleteDocument(docno, path);
+            live.erase(docno);
+        }
+    }
+    size_t purgedDocs = countMainDocs(path);
+    check(purgedDocs < mainDocs, "deleting a fifth of the main index purges it");
+    compareWithFreshBuild("a purged index matches a fresh build");
+}
+
+// -------------------- Positions --------------------
+static void testPositionsCodec() {
+    std::string encoded;
+    std::vector<uint32_t> values = {0, 1, 127, 128, 16383, 16384, 2097152, 4294967295u};
+    for (uint32_t value : values) encodeVByte(value, encoded);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(encoded.data());
+    const unsigned char* end = p + encoded.size();
+    bool sameValues = true;
+    for (uint32_t value : values) sameValues = sameValues && decodeVByte(p, end) == value;
+    check(sameValues && p == end, "VByte values survive a round-trip");
+
+    std::vector<std::vector<int>> postings = {{0, 1, 2}, {}, {5}, {7, 300, 70000, 2000000000}, {4, 9}};
+    std::string block;
+    for (const auto& positions : postings) encodePositions(positions, block);
+    PositionListReader reader(block);
+    check(reader.positionsAt(0) == postings[0], "positions of the first posting");
+    check(reader.positionsAt(1).empty(), "a posting without positions");
+    check(reader.positionsAt(3) == postings[3], "positions after a skipped posting");
+    check(reader.positionsAt(4) == postings[4], "positions of the last posting");
+}
+
+static void testPhraseMatching() {
+    auto phrase = [](std::vector<const std::vector<int>*> terms) { return countPhraseMatches(terms); };
+    auto window = [](std::vector<const std::vector<int>*> terms, int size) { return countWindowMatches(terms, size); };
+
+    std::vector<int> newPositions = {1, 5}, yorkPositions = {2, 7};
+    check(phrase({&newPositions, &yorkPositions}) == 1, "\"new york\" phrase");
+    check(phrase({&yorkPositions, &newPositions}) == 0, "\"york new\" phrase");
+    check(window({&yorkPositions, &newPositions}, 2) == 1, "\"york new\" in any order within 2");
+    check(window({&yorkPositions, &newPositions}, 3) == 2, "\"york new\" in any order within 3");
+
+    // A repeated query term needs as many distinct occurrences
+    std::vector<int> once = {3}, twiceApart = {3, 6}, run = {3, 4, 5}, split = {3, 4, 9};
+    check(phrase({&once, &once}) == 0, "\"york york\" phrase with a single york");
+    check(phrase({&split, &split}) == 1, "\"york york\" phrase once");
+    check(phrase({&run, &run}) == 2, "overlapping \"york york\" phrases");
+    check(window({&once, &once}, 5) == 0, "\"york york\" window with a single york");
+    check(window({&twiceApart, &twiceApart}, 4) == 1, "\"york york\" window spanning 4 positions");
+    check(window({&twiceApart, &twiceApart}, 3) == 0, "\"york york\" window too small");
+    std::vector<int> copy = twiceApart;
+    check(window({&twiceApart, &copy}, 4) == 1, "equal position lists count as one repeated term");
+    check(window({&newPositions, &once, &once}, 10) == 0, "\"new york york\" window with a single york");
+}
+
+// searchPhrase over the main index and a segment, with repeated and reordered terms
+static void testPhraseSearch(const std::string& workDir) {
+    std::string path = workDir + "/phrases";
+    buildIndex({{0, L"new york york city"}, {1, L"york new city"}, {2, L"new city york"}}, path, true, 3);
+    {
+        MuteOutput mute;
+        InvertedIndex index;
+        check(index.appendSegment({{3, L"york york"}, {4, L"york"}}, path), "append of phrase documents");
+    }
+
+    MuteOutput mute;
+    InvertedIndex index;
+    index.setVerbose(false);
+    check(index.loadIndex(path), "load of the phrase index");
+    auto docnos = [&](const std::wstring& query, int window) {
+        std::set<int> result;
+        for (const auto& hit : index.searchPhrase(query, window)) result.insert(index.docno(hit.docID));
+        return result;
+    };
+    check(docnos(L"new york", 0) == std::set<int>({0}), "exact phrase search");
+    check(docnos(L"york york", 0) == std::set<int>({0, 3}), "exact phrase search with a repeated term");
+    check(docnos(L"new york", 3) == std::set<int>({0, 1, 2}), "window search in any order");
+    check(docnos(L"york york", 3) == std::set<int>({0, 3}), "window search with a repeated term");
+    check(docnos(L"new york", 1).empty(), "a window smaller than the phrase matches nothing");
+}
+
+// -------------------- Query parser --------------------
+// Compact rendering of a parsed tree: (+required optional -excluded), (a | b), "phrase"~window, ^boost
+static std::string describe(const QueryNode& node) {
+    std::string out;
+    switch (node.type) {
+        case QueryNode::Type::Term:
+            out = wstringToUtf8(node.terms[0]);
+            break;
+        case QueryNode::Type::Phrase:
+            out = "\"";
+            for (size_t i = 0; i < node.terms.size(); ++i) out += (i ? " " : "") + wstringToUtf8(node.terms[i]);
+            out += "\"";
+            if (node.window > 0) out += "~" + std::to_string(node.window);
+            break;
+        case QueryNode::Type::Boolean: {
+            std::vector<std::string> parts;
+            for (const auto& child : node.required) parts.push_back("+" + describe(*child));
+            for (const auto& child : node.optional) parts.push_back(describe(*child));
+            for (const auto& child : node.excluded) parts.push_back("-" + describe(*child));
+            out = "(";
+            for (size_t i = 0; i < parts.size(); ++i) out += (i ? " " : "") + parts[i];
+            out += ")";
+            break;
+        }
+        case QueryNode::Type::Or:
+            out = "(";
+            for (size_t i = 0; i < node.children.size(); ++i) out += (i ? " | " : "") + describe(*node.children[i]);
+            out += ")";
+            break;
+    }
+    if (node.boost != 1.0) {
+        std::ostringstream boost;
+        boost << node.boost;
+        out += "^" + boost.str();
+    }
+    return out;
+}
+
+// Parsed tree of a valid query, or "error" for a rejected one (which must also explain why)
+static std::string parsed(const std::string& query, bool conjunctive = false) {
+    std::string error;
+    std::unique_ptr<QueryNode> root = QueryParser(conjunctive).parse(utf8ToWstring(query), error);
+    if (!root) return error.empty() ? "error without message" : "error";
+    return describe(*root);
+}
+
+static void testQueryParser() {
+    // Precedence: adjacency and AND bind tighter than OR; the default operator applies to adjacency only
+    check(parsed("a b OR c") == "((a b) | c)", "OR binds looser than adjacency");
+    check(parsed("a b OR c", true) == "((+a +b) | c)", "conjunctive default operator");
+    check(parsed("a AND b OR c d") == "((+a +b) | (c d))", "AND binds tighter than OR");
+    check(parsed("+a -b c") == "(+a c -b)", "required, optional and excluded clauses");
+    check(parsed("a NOT b", true) == "(+a -b)", "NOT excludes");
+    check(parsed("+(a b) -(c OR d)") == "(+(a b) -(c | d))", "operators on groups");
+    check(parsed("(a OR b)^2 c") == "((a | b)^2 c)", "group boost");
+    check(parsed("\"new york\"~3^2 river^2.5") == "(\"new york\"~3^2 river^2.5)", "phrase window, phrase and term boosts");
+    check(parsed("((a))") == "a", "lone clauses are unwrapped");
+
+    // Malformed queries
+    for (const char* query : {"", "   ", "(a", "a)", "\"new york", "\"\"", "()", "a OR", "OR a", "-a", "NOT a"}) {
+        check(parsed(query) == "error", std::string("rejects ") + query);
+    }
+
+    // Limits: nesting depth, boosts and windows
+    std::string deepest = std::string(QueryParser::maxDepth, '(') + "a" + std::string(QueryParser::maxDepth, ')');
+    check(parsed(deepest) == "a", "groups nested maxDepth levels deep");
+    check(parsed("(" + deepest + ")") == "error", "groups nested deeper than maxDepth");
+    check(parsed(std::string(100000, '(') + "a") == "error", "very deep nesting is rejected without recursing");
+    for (const char* query : {"a^nan", "a^inf", "a^-inf", "a^0", "a^-1", "a^2x", "a^", "\"a b\"~-1", "\"a b\"~x"}) {
+        check(parsed(query) == "error", std::string("rejects ") + query);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string workDir = (argc > 1) ? argv[1] : "tests_work";
+    std::filesystem::remove_all(workDir);
+    std::filesystem::create_directories(workDir);
+
+    testAppendAndMerge(workDir);
+    testDeletedDocsFile(workDir);
+    testDeleteAndUpdate(workDir);
+    testPositionsCodec();
+    testPhraseMatching();
+    testPhraseSearch(workDir);
+    testQueryParser();
+
+    if (failures > 0) {
+        std::cerr << " " << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cerr << " All checks passed" << std::endl;
+    std::filesystem::remove_all(workDir);
+    return 0;
+}
@@ -69,7 +69,19 @@ std::wstring preprocessWord(const std::wstring &word) {
         //std::wcout << L"Before stemming: " << result << std::endl;
 
         if (!result.empty()) {
-            static sb_stemmer* stemmer = sb_stemmer_new("english", nullptr);
+            // One stemmer per thread: a Snowball stemmer keeps per-call state (shards are built in parallel).
+            // The holder frees it when the thread exits, so server workers and build threads don't leak one each.
+            struct StemmerHolder {
+                sb_stemmer* stemmer = sb_stemmer_new("english", nullptr);
+                StemmerHolder() = default;
+                StemmerHolder(const StemmerHolder&) = delete;
+                StemmerHolder& operator=(const StemmerHolder&) = delete;
+                ~StemmerHolder() {
+                    if (stemmer) sb_stemmer_delete(stemmer);
+                }
+            };
+            static thread_local StemmerHolder holder;
+            sb_stemmer* stemmer = holder.stemmer;
             if (!stemmer) {
                 std::cerr << "Error: Could not initialize Snowball stemmer." << std::endl;
                 return result;